@@ -67,12 +67,28 @@ else (NOT WITH_VIRTIO_DEVICE)
 	add_definitions(-DVIRTIO_DEVICE_SUPPORT=1)
 endif (NOT WITH_VIRTIO_DEVICE)
 
+# Fix the VIRTIO_RING_F_EVENT_IDX feature at build time, negotiated at run
+# time if not defined
+if (DEFINED WITH_EVENT_IDX)
+  if (WITH_EVENT_IDX)
+    add_definitions(-DVIRTIO_EVENT_IDX_SUPPORT=1)
+  else (WITH_EVENT_IDX)
+    add_definitions(-DVIRTIO_EVENT_IDX_SUPPORT=0)
+  endif (WITH_EVENT_IDX)
+endif (DEFINED WITH_EVENT_IDX)
+
 option (WITH_VIRTIO_MMIO_DRV "Build with virtio mmio driver support enabled" OFF)
 
 if (WITH_VIRTIO_MMIO_DRV)
   add_definitions(-DWITH_VIRTIO_MMIO_DRV)
 endif (WITH_VIRTIO_MMIO_DRV)
 
+option (WITH_LZ4_LOADER "Build with LZ4 compressed ELF image loader" OFF)
+
+if (WITH_LZ4_LOADER)
+  add_definitions(-DWITH_LZ4_LOADER)
+endif (WITH_LZ4_LOADER)
+
 option (WITH_VQ_RX_EMPTY_NOTIFY "Build with virtqueue rx empty notify enabled" OFF)
 
 if (NOT WITH_VQ_RX_EMPTY_NOTIFY)
@@ -81,6 +97,14 @@ else (NOT WITH_VQ_RX_EMPTY_NOTIFY)
   add_definitions(-DVQ_RX_EMPTY_NOTIFY=1)
 endif (NOT WITH_VQ_RX_EMPTY_NOTIFY)
 
+option (WITH_VQ_INLINE "Build with inline virtqueue hot path in rpmsg virtio" OFF)
+
+if (NOT WITH_VQ_INLINE)
+  add_definitions(-DVQ_INLINE=0)
+else (NOT WITH_VQ_INLINE)
+  add_definitions(-DVQ_INLINE=1)
+endif (NOT WITH_VQ_INLINE)
+
 option (WITH_DCACHE "Build with all cache operations enabled" OFF)
 
 if (WITH_DCACHE)
@@ -106,6 +130,18 @@ if (DEFINED RPMSG_BUFFER_SIZE)
   add_definitions( -DRPMSG_BUFFER_SIZE=${RPMSG_BUFFER_SIZE} )
 endif (DEFINED RPMSG_BUFFER_SIZE)
 
+if (DEFINED VRING_CACHE_LINE_SIZE)
+  add_definitions( -DVRING_CACHE_LINE_SIZE=${VRING_CACHE_LINE_SIZE} )
+endif (DEFINED VRING_CACHE_LINE_SIZE)
+
+if (DEFINED RPMSG_VIRTIO_MAX_QPAIRS)
+  add_definitions( -DRPMSG_VIRTIO_MAX_QPAIRS=${RPMSG_VIRTIO_MAX_QPAIRS} )
+endif (DEFINED RPMSG_VIRTIO_MAX_QPAIRS)
+
+if (DEFINED RPROC_LOAD_ASYNC_DEPTH)
+  add_definitions( -DRPROC_LOAD_ASYNC_DEPTH=${RPROC_LOAD_ASYNC_DEPTH} )
+endif (DEFINED RPROC_LOAD_ASYNC_DEPTH)
+
 option (WITH_DOC "Build with documentation" OFF)
 
 message ("-- C_FLAGS : ${CMAKE_C_FLAGS}")
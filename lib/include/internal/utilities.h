@@ -5,8 +5,12 @@
  *
  */
 
+#include <stdint.h>
 #include <string.h>
 
+/** Initial value of fnv1a_hash32() */
+#define FNV1A_HASH32_INIT 0x811c9dc5U
+
 /**
  * @internal
  *
@@ -33,3 +37,78 @@
  */
 size_t safe_strcpy(char *dst, size_t d_size, const char *src, size_t s_size);
 
+/**
+ * @internal
+ *
+ * @brief Updates a 32-bit FNV-1a hash with a buffer content.
+ *
+ * @param hash Hash of the previous data, FNV1A_HASH32_INIT to start a new hash.
+ * @param data Pointer to the data to hash.
+ * @param len  Length of the data.
+ * @return     The updated hash.
+ */
+uint32_t fnv1a_hash32(uint32_t hash, const void *data, size_t len);
+
+/** @internal State of an xxh32_update() hash */
+struct xxh32_state {
+	/** Accumulators of the 16-byte stripes */
+	uint32_t v[4];
+
+	/** Length of the data hashed so far, modulo 2^32 */
+	uint32_t total_len;
+
+	/** Non-zero once at least one stripe has been hashed */
+	unsigned int large;
+
+	/** Data not hashed yet, less than a stripe */
+	unsigned char buf[16];
+
+	/** Length of the data in buf */
+	unsigned int buf_len;
+
+	/** Seed of the hash */
+	uint32_t seed;
+};
+
+/**
+ * @internal
+ *
+ * @brief Starts an xxHash32 hash.
+ *
+ * @param state Pointer to the hash state.
+ * @param seed  Seed of the hash, 0 for the LZ4 frame checksums.
+ */
+void xxh32_init(struct xxh32_state *state, uint32_t seed);
+
+/**
+ * @internal
+ *
+ * @brief Updates an xxHash32 hash with a buffer content.
+ *
+ * @param state Pointer to the hash state.
+ * @param data  Pointer to the data to hash.
+ * @param len   Length of the data.
+ */
+void xxh32_update(struct xxh32_state *state, const void *data, size_t len);
+
+/**
+ * @internal
+ *
+ * @brief Returns the xxHash32 hash of the data hashed so far.
+ *
+ * @param state Pointer to the hash state.
+ * @return      The hash.
+ */
+uint32_t xxh32_digest(const struct xxh32_state *state);
+
+/**
+ * @internal
+ *
+ * @brief Computes the xxHash32 hash of a buffer content.
+ *
+ * @param data Pointer to the data to hash.
+ * @param len  Length of the data.
+ * @param seed Seed of the hash.
+ * @return     The hash.
+ */
+uint32_t xxh32(const void *data, size_t len, uint32_t seed);
@@ -83,6 +83,8 @@ typedef struct {
 
 /* e_machine */
 #define     EM_ARM          40	/* ARM/Thumb Architecture    */
+#define     EM_AARCH64      183	/* ARM 64-bit Architecture   */
+#define     EM_RISCV        243	/* RISC-V Architecture       */
 
 /* e_version */
 #define     EV_CURRENT      1	/* Current version           */
@@ -169,6 +171,11 @@ typedef struct elf64_phdr {
 #define PT_LOPROC  0x70000000
 #define PT_HIPROC  0x7fffffff
 
+/* segment flags */
+#define PF_X       0x1
+#define PF_W       0x2
+#define PF_R       0x4
+
 /* ELF32 section header. */
 typedef struct {
 	Elf32_Word sh_name;
@@ -258,6 +265,32 @@ typedef struct elf64_rela {
 #define ELF64_R_SYM(i)  ((i) >> 32)
 #define ELF64_R_TYPE(i) ((i) & 0xffffffff)
 
+/* Dynamic section entry */
+typedef struct {
+	Elf32_Sword d_tag;
+	union {
+		Elf32_Word d_val;
+		Elf32_Addr d_ptr;
+	} d_un;
+} Elf32_Dyn;
+
+typedef struct {
+	Elf64_Sxword d_tag;
+	union {
+		Elf64_Xword d_val;
+		Elf64_Addr d_ptr;
+	} d_un;
+} Elf64_Dyn;
+
+/* Dynamic section tags */
+#define     DT_NULL         0
+#define     DT_RELA         7
+#define     DT_RELASZ       8
+#define     DT_RELAENT      9
+#define     DT_REL          17
+#define     DT_RELSZ        18
+#define     DT_RELENT       19
+
 /* Symbol table entry */
 typedef struct {
 	Elf32_Word st_name;
@@ -283,6 +316,18 @@ typedef struct elf64_sym {
 #define     R_ARM_RELATIVE	23	/* 0x17 */
 #define     R_ARM_ABS32		2	/* 0x02 */
 
+/* AArch64 and RISC-V relative relocation codes */
+#define     R_AARCH64_RELATIVE	1027	/* 0x403 */
+#define     R_RISCV_RELATIVE	3	/* 0x03 */
+
+/* Section name to section index hash table */
+struct elf_section_hash {
+	/* Section index + 1 in each slot, 0 for a free slot */
+	unsigned short *slots;
+	/* Number of slots - 1, the number of slots is a power of 2 */
+	unsigned int mask;
+};
+
 /* ELF decoding information */
 struct elf32_info {
 	Elf32_Ehdr ehdr;
@@ -290,6 +335,11 @@ struct elf32_info {
 	Elf32_Phdr *phdrs;
 	Elf32_Shdr *shdrs;
 	void *shstrtab;
+	/* The tables point into the mapped image, they are not allocated */
+	int mapped;
+	struct elf_section_hash shash;
+	/* Placement of a relocatable image, set by elf_load() */
+	struct remoteproc_reloc reloc;
 };
 
 struct elf64_info {
@@ -298,6 +348,11 @@ struct elf64_info {
 	Elf64_Phdr *phdrs;
 	Elf64_Shdr *shdrs;
 	void *shstrtab;
+	/* The tables point into the mapped image, they are not allocated */
+	int mapped;
+	struct elf_section_hash shash;
+	/* Placement of a relocatable image, set by elf_load() */
+	struct remoteproc_reloc reloc;
 };
 
 #define ELF_STATE_INIT              0x0L
@@ -349,6 +404,28 @@ int elf_load_header(const void *img_data, size_t offset, size_t len,
 		    void **img_info, int last_load_state,
 		    size_t *noffset, size_t *nlen);
 
+/**
+ * @internal
+ *
+ * @brief Load ELF headers from a mapped image
+ *
+ * Same as elf_load_header(), but the whole image is resident in local
+ * memory. The headers are parsed in a single pass and the program header,
+ * section header and section name tables are used in place in the image,
+ * which must stay valid as long as the image information is used. The
+ * PT_LOAD segments are checked to be within the image.
+ *
+ * @param img_data	Image data, starting at the image file beginning
+ * @param len		Image length
+ * @param img_info	Pointer to store image information data
+ *
+ * @return ELF loading header state, -RPROC_EAGAIN if the tables cannot be
+ * used in place and elf_load_header() has to be used, or other negative
+ * value for failure
+ */
+int elf_load_header_mapped(const void *img_data, size_t len,
+			   void **img_info);
+
 /**
  * @internal
  *
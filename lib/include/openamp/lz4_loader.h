@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**************************************************************************
+ * FILE NAME
+ *
+ *       lz4_loader.h
+ *
+ * COMPONENT
+ *
+ *         OpenAMP stack.
+ *
+ * DESCRIPTION
+ *
+ *       This file provides definitions for the LZ4 compressed ELF loader
+ *
+ *
+ **************************************************************************/
+#ifndef LZ4_LOADER_H_
+#define LZ4_LOADER_H_
+
+#include <openamp/remoteproc.h>
+#include <openamp/remoteproc_loader.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/* LZ4 frame magic number */
+#define LZ4_FRAME_MAGIC 0x184D2204UL
+
+/*
+ * LZ4 frames can reference up to 64KB of the previous blocks output, this
+ * history is kept next to the current block output
+ */
+#define LZ4_HISTORY_SIZE 0x10000
+
+extern const struct loader_ops lz4_ops;
+
+/**
+ * @internal
+ *
+ * @brief Check if it is an LZ4 frame
+ *
+ * It will check if the input image header is an LZ4 frame header.
+ *
+ * @param img_data	Firmware private data which will be passed to user
+ *			defined loader operations
+ * @param len		Firmware header length
+ *
+ * @return 0 for success or negative value for failure.
+ */
+int lz4_identify(const void *img_data, size_t len);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif /* LZ4_LOADER_H_ */
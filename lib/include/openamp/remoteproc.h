@@ -365,6 +365,16 @@ struct loader_ops;
 struct image_store_ops;
 struct remoteproc_ops;
 
+/* Remoteproc memory fill modes */
+/* Fill with metal_io_block_set() */
+#define RPROC_MEM_FILL_IO	0
+/* Fill with memset() on the virtual address, for normal memory only */
+#define RPROC_MEM_FILL_MEMSET	1
+/* Fill with the remoteproc fill operation, e.g. a DMA engine */
+#define RPROC_MEM_FILL_OPS	2
+/* Memory is already zeroed, skip zero fills */
+#define RPROC_MEM_FILL_ZEROED	3
+
 /** @brief Memory used by the remote processor */
 struct remoteproc_mem {
 	/** Device memory */
@@ -382,8 +392,110 @@ struct remoteproc_mem {
 	/** Pointer to the I/O region */
 	struct metal_io_region *io;
 
+	/**
+	 * How the loader fills the memory after the segment data, e.g. the
+	 * .bss, one of RPROC_MEM_FILL_*, set to RPROC_MEM_FILL_IO by
+	 * remoteproc_init_mem()
+	 */
+	unsigned int fill;
+
 	/** List node */
 	struct metal_list node;
+
+	/**
+	 * Maximum number of loads to this memory at the same time in
+	 * remoteproc_load_parallel(), set to 1 by remoteproc_init_mem()
+	 */
+	unsigned int max_loads;
+};
+
+/** @brief Segment recorded in a remoteproc load cache */
+struct remoteproc_load_cache_seg {
+	/** Physical address of the segment in the target memory */
+	metal_phys_addr_t pa;
+
+	/** Offset of the segment data in the image */
+	size_t offset;
+
+	/** Length of the segment data */
+	size_t len;
+
+	/** I/O region of a read-only segment, NULL for a writable one */
+	struct metal_io_region *io;
+
+	/** Hash of the target memory once loaded, 0 if not known */
+	uint32_t hash;
+};
+
+/**
+ * @brief Cache of the last image loaded to a remote processor
+ *
+ * Initialized with remoteproc_init_load_cache() and set to the remoteproc
+ * instance with remoteproc_set_load_cache().
+ */
+struct remoteproc_load_cache {
+	/** Hash of the whole image */
+	uint32_t image_hash;
+
+	/** Non-zero if the cache describes a successfully completed load */
+	unsigned int valid;
+
+	/** Number of segments of the cached image */
+	unsigned int num_segs;
+
+	/** Maximum number of segments which can be cached */
+	unsigned int max_segs;
+
+	/** Segments, max_segs entries */
+	struct remoteproc_load_cache_seg *segs;
+};
+
+/** @brief Segment changed by a remoteproc delta load */
+struct remoteproc_delta_seg {
+	/** Device address of the segment, as in the image program header */
+	metal_phys_addr_t da;
+
+	/** Length of the segment data */
+	size_t len;
+
+	/** Hash of the base segment data, checked if read-only, 0 not to check */
+	uint32_t base_hash;
+
+	/** Hash of the segment data of the new image */
+	uint32_t hash;
+};
+
+/**
+ * @brief Changes of an image from the base image resident in target memory
+ *
+ * The hashes are 32-bit FNV-1a hashes of the segment data, which can be
+ * computed offline when the update is built.
+ */
+struct remoteproc_load_delta {
+	/** Number of changed segments */
+	unsigned int num_segs;
+
+	/** Changed segments, num_segs entries */
+	const struct remoteproc_delta_seg *segs;
+};
+
+/**
+ * @brief Placement of a relocatable image
+ *
+ * Set to the remoteproc instance with remoteproc_set_reloc().
+ */
+struct remoteproc_reloc {
+	/** Offset added to the device addresses of the read-only segments */
+	metal_phys_addr_t ro_offset;
+
+	/** Offset added to the device addresses of the writable segments */
+	metal_phys_addr_t rw_offset;
+
+	/**
+	 * Non-zero if the read-only segments are already loaded at ro_offset,
+	 * e.g. by another instance of the image sharing them
+	 */
+	unsigned int ro_shared;
 };
 
 /**
@@ -429,6 +541,12 @@ struct remoteproc {
 
 	/** Private data */
 	void *priv;
+
+	/** Optional cache of the last loaded image */
+	struct remoteproc_load_cache *load_cache;
+
+	/** Placement of a relocatable image */
+	struct remoteproc_reloc reloc;
 };
 
 /**
@@ -491,6 +609,23 @@ struct remoteproc_ops {
 					  metal_phys_addr_t da,
 					  void *va, size_t size,
 					  struct remoteproc_mem *buf);
+
+	/**
+	 * @brief Fill remoteproc memory with a value, e.g. with a DMA engine.
+	 * Used by the loader for the memories with the RPROC_MEM_FILL_OPS
+	 * fill mode.
+	 *
+	 * @param rproc		Pointer to remoteproc instance
+	 * @param pa		Physical address of the memory to fill
+	 * @param io		Pointer to the I/O region of the memory
+	 * @param value		Value to fill the memory with
+	 * @param size		Size to fill
+	 *
+	 * @return 0 for success, negative value for failure
+	 */
+	int (*fill)(struct remoteproc *rproc, metal_phys_addr_t pa,
+		    struct metal_io_region *io, unsigned char value,
+		    size_t size);
 };
 
 /* Remoteproc error codes */
@@ -661,6 +796,24 @@ void *remoteproc_mmap(struct remoteproc *rproc,
 		      size_t size, unsigned int attribute,
 		      struct metal_io_region **io);
 
+/**
+ * @brief Fill remoteproc memory as its memory fill mode allows
+ *
+ * Used by the loaders to fill the memory after the segment data, e.g. the
+ * .bss, with the fill mode of the remoteproc memory containing it.
+ *
+ * @param rproc	Pointer to the remoteproc instance
+ * @param pa	Physical address of the memory to fill
+ * @param io	I/O region of the memory to fill
+ * @param value	Fill value
+ * @param size	Size of the memory to fill
+ *
+ * @return 0 for success and negative value for errors
+ */
+int remoteproc_fill(struct remoteproc *rproc, metal_phys_addr_t pa,
+		    struct metal_io_region *io, unsigned char value,
+		    size_t size);
+
 /**
  * @brief Parse and set resource table of remoteproc
  *
@@ -735,6 +888,160 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		    void *store, const struct image_store_ops *store_ops,
 		    void **img_info);
 
+/**
+ * @brief Initialize a remoteproc load cache
+ *
+ * The cache is empty after the initialization, call it again to drop the
+ * cached image, e.g. when the image file has changed.
+ *
+ * @param cache		Pointer to the load cache
+ * @param segs		Array of segments to record the image segments in
+ * @param max_segs	Number of entries of segs
+ */
+void remoteproc_init_load_cache(struct remoteproc_load_cache *cache,
+				struct remoteproc_load_cache_seg *segs,
+				unsigned int max_segs);
+
+/**
+ * @brief Set the load cache of a remoteproc instance
+ *
+ * When a load cache is set, the loader records the identity of the image:
+ * a hash of the whole image and the segment table, and a hash of the target
+ * memory of the segments the loader reports read-only to the remote
+ * (RPROC_LOADER_DATA_RO), e.g. the code. The record is only trusted once the
+ * load has completed successfully. When the same image is loaded again, a
+ * read-only segment whose target memory still matches its hash, e.g. after
+ * a crash of the remote, is not loaded again. The writable segments are
+ * always loaded, and the memory after the segment data, e.g. the .bss, is
+ * always filled.
+ *
+ * The image must be resident, with the SUPPORT_MAPPED store feature, to be
+ * hashed as a whole. The cache is not used otherwise.
+ *
+ * The hashes are 32-bit FNV-1a, they detect an accidental change, not a
+ * deliberate collision.
+ *
+ * @param rproc	Pointer to the remoteproc instance
+ * @param cache	Pointer to the load cache, NULL to disable the cache
+ *
+ * @return 0 for success, negative value for failure
+ */
+int remoteproc_set_load_cache(struct remoteproc *rproc,
+			      struct remoteproc_load_cache *cache);
+
+/**
+ * @brief Set the placement of the relocatable image of a remoteproc instance
+ *
+ * The next loads place the segments of a position-independent image (ELF
+ * ET_DYN) at their link address plus the offset of the read-only or
+ * writable segments, and apply the image dynamic relocations for the same
+ * offsets. Several instances of the same image can so be loaded to
+ * different carve-outs. The offsets must be 0 for other images.
+ *
+ * The read-only and writable offsets can only differ if the read-only
+ * segments do not access the writable ones relative to their own address,
+ * e.g. ARM ROPI/RWPI images. The instances can then share the read-only
+ * segments where they all can access the same memory: all of them use the
+ * same ro_offset, and all but the first one loaded set ro_shared to neither
+ * load nor relocate the read-only segments again.
+ *
+ * The load cache and the delta loads are not used with non-zero offsets, the
+ * segments left intact would be relocated again.
+ *
+ * @param rproc	Pointer to the remoteproc instance
+ * @param reloc	Pointer to the image placement, NULL to load at the link
+ *		addresses
+ *
+ * @return 0 for success, negative value for failure
+ */
+int remoteproc_set_reloc(struct remoteproc *rproc,
+			 const struct remoteproc_reloc *reloc);
+
+/**
+ * @brief Loads the changed segments of the executable
+ *
+ * Same as remoteproc_load(), but the base image of the executable is
+ * expected resident in the target memory, e.g. from a previous load, and
+ * only the read-only segments listed in the delta are loaded. The other
+ * read-only segments are neither read from the store nor written to the
+ * target memory. The writable segments, e.g. the .data, were changed by the
+ * run of the base image and are always loaded. The store only needs to
+ * provide the headers, the resource table and the data of the writable and
+ * changed segments. The memory after the segment data, e.g. the .bss, is
+ * filled for all the segments.
+ *
+ * A changed read-only segment already matching its new hash in the target
+ * memory is not loaded again, so an interrupted update can be resumed.
+ * Otherwise the target memory must match the base hash of the segment, if
+ * set. Every changed segment must match its new hash once loaded, and every
+ * delta entry must match a segment of the image, or the load fails.
+ *
+ * @param rproc		Pointer to the remoteproc instance
+ * @param path		Optional path to the image file
+ * @param store		Pointer to user defined image store argument
+ * @param store_ops	Pointer to image store operations
+ * @param delta		Pointer to the changed segments
+ * @param img_info	Pointer to memory which stores image information used
+ *			by remoteproc loader
+ *
+ * @return 0 for success and negative value for failure
+ */
+int remoteproc_load_delta(struct remoteproc *rproc, const char *path,
+			  void *store, const struct image_store_ops *store_ops,
+			  const struct remoteproc_load_delta *delta,
+			  void **img_info);
+
+/**
+ * @brief Loads the executable with pipelined target memory loads
+ *
+ * Same as remoteproc_load(), but the executable segments are loaded to the
+ * target memory with non-blocking store_ops->load() calls. The loader goes on
+ * parsing and starts the load of the next segments while the store copies
+ * the previous ones, with up to RPROC_LOAD_ASYNC_DEPTH loads in flight. The
+ * store reports the end of each load through store_ops->load_complete(), in
+ * the order the loads were started. All the loads are completed before this
+ * function returns.
+ *
+ * @param rproc		Pointer to the remoteproc instance
+ * @param path		Optional path to the image file
+ * @param store		Pointer to user defined image store argument
+ * @param store_ops	Pointer to image store operations, load_complete must
+ *			be set
+ * @param img_info	Pointer to memory which stores image information used
+ *			by remoteproc loader
+ *
+ * @return 0 for success and negative value for failure
+ */
+int remoteproc_load_async(struct remoteproc *rproc, const char *path,
+			  void *store, const struct image_store_ops *store_ops,
+			  void **img_info);
+
+/**
+ * @brief Loads the executable with concurrent target memory loads
+ *
+ * Same as remoteproc_load_async(), but all the executable segments are
+ * resolved to their target memory before any of them is loaded. The loads
+ * are then started together, with up to RPROC_LOAD_ASYNC_DEPTH loads in
+ * flight and up to max_loads loads to the same remoteproc memory. A store
+ * running its non-blocking loads on a pool of workers can so copy the
+ * segments of independent memories concurrently. All the loads are
+ * completed before this function returns.
+ *
+ * @param rproc		Pointer to the remoteproc instance
+ * @param path		Optional path to the image file
+ * @param store		Pointer to user defined image store argument
+ * @param store_ops	Pointer to image store operations, load_complete must
+ *			be set
+ * @param img_info	Pointer to memory which stores image information used
+ *			by remoteproc loader
+ *
+ * @return 0 for success and negative value for failure
+ */
+int remoteproc_load_parallel(struct remoteproc *rproc, const char *path,
+			     void *store,
+			     const struct image_store_ops *store_ops,
+			     void **img_info);
+
 /**
  * @brief Loads the executable
  *
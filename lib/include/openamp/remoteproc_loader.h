@@ -34,6 +34,22 @@ extern "C" {
 
 /* Loader feature macros */
 #define SUPPORT_SEEK 1UL
+/* The image data returned by open() is the whole image, e.g. mmap()ed or XIP */
+#define SUPPORT_MAPPED 2UL
+
+/*
+ * Loader decompresses the image, its image offsets are not image store
+ * offsets and the resource table is read from the loaded target memory
+ */
+#define LOADER_DECOMPRESS 1UL
+
+/*
+ * Maximum number of pending non-blocking loads in remoteproc_load_async()
+ * and remoteproc_load_parallel(), e.g. the number of store workers
+ */
+#ifndef RPROC_LOAD_ASYNC_DEPTH
+#define RPROC_LOAD_ASYNC_DEPTH 2
+#endif
 
 /* Remoteproc loader any address */
 #define RPROC_LOAD_ANYADDR ((metal_phys_addr_t)-1)
@@ -53,6 +69,8 @@ extern "C" {
 #define RPROC_LOADER_PRIVATE_MASK   0x0000FFFFL
 /* Remoteproc loader reserved mask */
 #define RPROC_LOADER_RESERVED_MASK  0x0F000000L
+/* Flag of load_data(): the segment returned is not writable by the remote */
+#define RPROC_LOADER_DATA_RO        0x01000000L
 
 /** @brief User-defined image store operations */
 struct image_store_ops {
@@ -62,7 +80,11 @@ struct image_store_ops {
 	/** User-defined callback to close the "firmware" to clean up after loading */
 	void (*close)(void *store);
 
-	/** User-defined callback to load the firmware contents to target memory or local memory */
+	/**
+	 * User-defined callback to load the firmware contents to target memory or local memory.
+	 * When is_blocking is 0, the load to target memory is only started and 0 is returned,
+	 * its completion is reported by load_complete.
+	 */
 	int (*load)(void *store, size_t offset, size_t size,
 		    const void **data,
 		    metal_phys_addr_t pa,
@@ -70,6 +92,13 @@ struct image_store_ops {
 
 	/** Loader supported features. e.g. seek */
 	unsigned int features;
+
+	/**
+	 * User-defined callback to wait for the oldest non-blocking load to complete,
+	 * returns the loaded size or a negative value on failure. Only required by
+	 * remoteproc_load_async().
+	 */
+	int (*load_complete)(void *store);
 };
 
 /** @brief Loader operations */
@@ -102,6 +131,19 @@ struct loader_ops {
 
 	/** Get load state from the image information */
 	int (*get_load_state)(void *img_info);
+
+	/** Loader features, e.g. LOADER_DECOMPRESS */
+	unsigned int features;
+
+	/**
+	 * Optional, define how to get all the executable headers at once when
+	 * the whole image is in local memory, returns -RPROC_EAGAIN to fall
+	 * back to load_header. The image information may point into the
+	 * image, it is only used when the image information is not returned
+	 * to the remoteproc_load() caller.
+	 */
+	int (*load_header_mapped)(const void *img_data, size_t len,
+				  void **img_info);
 };
 
 #if defined __cplusplus
@@ -60,7 +60,9 @@ struct remoteproc_virtio {
 /**
  * @brief Create rproc virtio vdev
  *
- * @param role		VIRTIO_DEV_DRIVER or VIRTIO_DEV_DEVICE
+ * @param role		VIRTIO_DEV_DRIVER or VIRTIO_DEV_DEVICE, must be a role
+ *			built in with VIRTIO_DRIVER_SUPPORT or
+ *			VIRTIO_DEVICE_SUPPORT
  * @param notifyid	Virtio device notification id
  * @param rsc		Pointer to the virtio device resource
  * @param rsc_io	Pointer to the virtio device resource I/O region
@@ -88,6 +90,10 @@ void rproc_virtio_remove_vdev(struct virtio_device *vdev);
 /**
  * @brief Initialize rproc virtio vring
  *
+ * The vring layout is selected when the virtqueue is created, from the
+ * negotiated features. If \ref VIRTIO_RING_F_CACHE_ALIGNED may be
+ * negotiated, the vring memory must hold vring_size_cache_aligned() bytes.
+ *
  * @param vdev		Pointer to the virtio device
  * @param index		vring index in the virtio device
  * @param notifyid	remoteproc vring notification id
@@ -127,6 +127,14 @@ struct rpmsg_device_ops {
 
 	/** Get RPMsg TX buffer size */
 	int (*get_tx_buffer_size)(struct rpmsg_device *rdev);
+
+	/**
+	 * Get RPMsg TX buffer for the source address, takes precedence
+	 * over get_tx_payload_buffer when the transport steers messages
+	 */
+	void *(*get_tx_payload_buffer_from)(struct rpmsg_device *rdev,
+					    uint32_t src, uint32_t *len,
+					    int wait);
 };
 
 /** @brief Representation of a RPMsg device */
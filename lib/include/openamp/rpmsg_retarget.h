@@ -8,9 +8,12 @@
 #ifndef RPMSG_RETARGET_H
 #define RPMSG_RETARGET_H
 
+#include <metal/condition.h>
 #include <metal/mutex.h>
 #include <openamp/open_amp.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #if defined __cplusplus
 extern "C" {
@@ -25,12 +28,50 @@ extern "C" {
 
 #define TERM_SYSCALL_ID  0x6UL
 
+/*
+ * Positioned, vectored and status system calls. The offset of the LSEEK,
+ * PREAD and PWRITE requests is an int64_t at the start of the data, before
+ * the data written by PWRITE. The LSEEK answer returns the resulting offset
+ * the same way. READV and WRITEV carry the concatenation of the vectors
+ * like READ and WRITE. The FSTAT answer data is a struct rpmsg_rpc_stat.
+ */
+#define LSEEK_SYSCALL_ID  0x7UL
+#define PREAD_SYSCALL_ID  0x8UL
+#define PWRITE_SYSCALL_ID 0x9UL
+#define READV_SYSCALL_ID  0xAUL
+#define WRITEV_SYSCALL_ID 0xBUL
+#define FSTAT_SYSCALL_ID  0xCUL
+
 #define DEFAULT_PROXY_ENDPOINT  0xFFUL
 
+/* Write modes */
+#define RPMSG_RPC_WRITE_SYNC     0 /* Wait for the ack of each write */
+#define RPMSG_RPC_WRITE_ASYNC    1 /* Send each write without waiting */
+#define RPMSG_RPC_WRITE_COALESCE 2 /* Coalesce writes into full buffers */
+
+/* Wait strategies */
+#define RPMSG_RPC_WAIT_SPIN       0 /* Call the poll function until done */
+#define RPMSG_RPC_WAIT_SPIN_BLOCK 1 /* Spin, then block on a condition */
+#define RPMSG_RPC_WAIT_BLOCK      2 /* Block on a condition */
+
+/* Sleep between the endpoint ready checks of the blocking strategies */
+#ifndef RPMSG_RPC_READY_SLEEP_US
+#define RPMSG_RPC_READY_SLEEP_US 1000
+#endif
+
+/*
+ * Request tags, see rpmsg_rpc_set_tagging(). The tag is carried in the upper
+ * bits of the syscall ID of the request and of its answer.
+ */
+#define RPMSG_RPC_TAG_SHIFT 16
+#define RPMSG_RPC_ID_MASK   0xFFFFUL
+
 struct rpmsg_rpc_data;
+struct rpmsg_rpc_waiter;
 
 typedef int (*rpmsg_rpc_poll)(void *arg);
 typedef void (*rpmsg_rpc_shutdown_cb)(struct rpmsg_rpc_data *rpc);
+typedef struct rpmsg_rpc_data *(*rpmsg_rpc_select)(int fd);
 
 struct rpmsg_rpc_syscall_header {
 	int32_t int_field1;
@@ -43,6 +84,65 @@ struct rpmsg_rpc_syscall {
 	struct rpmsg_rpc_syscall_header args;
 };
 
+/** @brief File status returned by the FSTAT system call */
+struct rpmsg_rpc_stat {
+	/** File type and mode, as st_mode */
+	uint32_t mode;
+
+	/** Reserved, 0 */
+	uint32_t reserved;
+
+	/** File size in bytes */
+	int64_t size;
+};
+
+/** @brief I/O vector of _readv() and _writev(), as struct iovec */
+struct rpmsg_rpc_iovec {
+	/** Start of the vector */
+	void *iov_base;
+
+	/** Length of the vector */
+	size_t iov_len;
+};
+
+/**
+ * @brief Read-ahead cache of a file
+ *
+ * The data read ahead is kept in a ring buffer provided by the application,
+ * see rpmsg_rpc_read_cache_init().
+ */
+struct rpmsg_rpc_read_cache {
+	/** File descriptor read ahead */
+	int fd;
+
+	/** Ring buffer of the data read ahead */
+	unsigned char *buf;
+
+	/** Size of the ring buffer */
+	uint32_t size;
+
+	/** Size of the read requests, the payload of a RPMsg buffer */
+	uint32_t chunk;
+
+	/** Offset of the first byte of data in the ring buffer */
+	uint32_t head;
+
+	/** Number of bytes of data in the ring buffer */
+	uint32_t len;
+
+	/** Number of read requests waiting for an answer */
+	unsigned int inflight;
+
+	/** Error returned by a read request */
+	int err;
+
+	/** End of file was reached */
+	int eof;
+
+	/** Next read-ahead cache of the RPMsg RPC */
+	struct rpmsg_rpc_read_cache *next;
+};
+
 struct rpmsg_rpc_data {
 	struct rpmsg_endpoint ept;
 	int ept_destroyed;
@@ -54,6 +154,29 @@ struct rpmsg_rpc_data {
 	rpmsg_rpc_shutdown_cb shutdown_cb;
 	metal_mutex_t lock;
 	struct metal_spinlock buflock;
+	/* Asynchronous writes, see rpmsg_rpc_set_write_mode() */
+	int write_mode;
+	void *wbuf;
+	uint32_t wbuf_len;
+	uint32_t wlen;
+	int wfd;
+	unsigned int wpending;
+	uint32_t wbytes;
+	int werr;
+	/* Read-ahead caches, see rpmsg_rpc_read_cache_init() */
+	struct rpmsg_rpc_read_cache *rcaches;
+	struct rpmsg_rpc_read_cache *rcache;
+	unsigned int rpending;
+	/* Tagged requests, see rpmsg_rpc_set_tagging() */
+	int tagged;
+	uint32_t next_tag;
+	struct rpmsg_rpc_waiter *waiters;
+	/* Wait strategy, see rpmsg_rpc_set_wait() */
+	int wait_mode;
+	unsigned int wait_spin;
+	unsigned int wait_blocked;
+	metal_mutex_t wait_lock;
+	struct metal_condition wait_cond;
 };
 
 /**
@@ -83,13 +206,47 @@ int rpmsg_rpc_init(struct rpmsg_rpc_data *rpc,
 		   void *poll_arg, rpmsg_rpc_poll poll,
 		   rpmsg_rpc_shutdown_cb shutdown_cb);
 
+/**
+ * @internal
+ *
+ * @brief Initialize RPMsg remote procedure call with a wait strategy
+ *
+ * This function is rpmsg_rpc_init() with the wait strategy of
+ * rpmsg_rpc_set_wait(), which also applies to the wait for the endpoint
+ * to be bound to the remote. With a blocking strategy, that wait sleeps
+ * RPMSG_RPC_READY_SLEEP_US between checks and does not call the poll
+ * function.
+ *
+ * @param rpc		Pointer to the global remote procedure call data
+ * @param rdev		Pointer to the rpmsg device
+ * @param ept_name	Name of the endpoint used by RPC
+ * @param ept_addr	Address of the endpoint used by RPC
+ * @param ept_raddr	Remote address of the endpoint used by RPC
+ * @param poll_arg	Pointer to poll function argument
+ * @param poll		Poll function
+ * @param shutdown_cb	Shutdown callback function
+ * @param wait_mode	Wait strategy
+ * @param wait_spin	Number of poll calls before blocking, for
+ *			RPMSG_RPC_WAIT_SPIN_BLOCK
+ *
+ * @return 0 for success, and negative value for failure.
+ */
+int rpmsg_rpc_init_with_wait(struct rpmsg_rpc_data *rpc,
+			     struct rpmsg_device *rdev,
+			     const char *ept_name, uint32_t ept_addr,
+			     uint32_t ept_raddr,
+			     void *poll_arg, rpmsg_rpc_poll poll,
+			     rpmsg_rpc_shutdown_cb shutdown_cb,
+			     int wait_mode, unsigned int wait_spin);
+
 /**
  * @internal
  *
  * @brief Release RPMsg remote procedure call
  *
  * This function is to release remoteproc procedure call
- * global data.
+ * global data. The asynchronous writes are flushed first. No caller must be
+ * waiting on the RPC.
  *
  * @param rpc	Pointer to the global remote procedure call
  */
@@ -115,6 +272,122 @@ int rpmsg_rpc_send(struct rpmsg_rpc_data *rpc,
 		   void *req, size_t len,
 		   void *resp, size_t resp_len);
 
+/**
+ * @internal
+ *
+ * @brief Set the wait strategy of RPMsg RPC
+ *
+ * The wait strategy is used by the RPC calls waiting for an answer of the
+ * remote. RPMSG_RPC_WAIT_SPIN, the default, calls the poll function until
+ * the answer is received. RPMSG_RPC_WAIT_SPIN_BLOCK calls the poll function
+ * up to spin times, then blocks on a condition signalled by the endpoint
+ * callback. RPMSG_RPC_WAIT_BLOCK blocks at once. The blocking strategies
+ * require the RPMsg messages to be received by another thread while the
+ * caller is blocked. The endpoint callback takes a mutex to wake a blocked
+ * caller, so it must not run in an interrupt handler with these strategies.
+ * The wait for the endpoint to be bound at init always spins, use
+ * rpmsg_rpc_init_with_wait() to give the strategy for it as well.
+ *
+ * @param rpc	Pointer to remoteproc procedure call data struct
+ * @param mode	Wait strategy
+ * @param spin	Number of poll calls before blocking, for
+ *		RPMSG_RPC_WAIT_SPIN_BLOCK
+ *
+ * @return 0 for success, and negative value for failure.
+ */
+int rpmsg_rpc_set_wait(struct rpmsg_rpc_data *rpc, int mode,
+		       unsigned int spin);
+
+/**
+ * @internal
+ *
+ * @brief Enable the tagging of the RPMsg RPC requests
+ *
+ * Without tags, the answers are matched to the requests by order and
+ * rpmsg_rpc_send() exchanges one request at a time. With tags, each request
+ * carries a tag in the upper bits of its syscall ID and the answer is
+ * delivered to the caller waiting for this tag, so several threads can have
+ * a request in flight on the same RPC at once. The remote must copy the
+ * syscall ID of the request, with its tag, in the answer.
+ *
+ * @param rpc		Pointer to remoteproc procedure call data struct
+ * @param enable	1 to tag the requests, 0 otherwise
+ */
+void rpmsg_rpc_set_tagging(struct rpmsg_rpc_data *rpc, int enable);
+
+/**
+ * @internal
+ *
+ * @brief Set the write mode of RPMsg RPC
+ *
+ * In the RPMSG_RPC_WRITE_ASYNC and RPMSG_RPC_WRITE_COALESCE modes, _write()
+ * returns once the data is in a RPMsg TX buffer and does not wait for the
+ * ack of the remote. In the RPMSG_RPC_WRITE_COALESCE mode, successive writes
+ * to the same file are gathered in the same TX buffer which is sent when it
+ * is full, before a write to another file or another syscall, or on
+ * rpmsg_rpc_flush(). A write error is returned by the next _write(), or by
+ * rpmsg_rpc_flush() and _close(). A write the remote did not complete is
+ * reported as -EIO once all the pending writes are acked.
+ *
+ * @param rpc	Pointer to remoteproc procedure call data struct
+ * @param mode	Write mode, RPMSG_RPC_WRITE_SYNC by default
+ *
+ * @return 0 for success, and negative value for failure.
+ */
+int rpmsg_rpc_set_write_mode(struct rpmsg_rpc_data *rpc, int mode);
+
+/**
+ * @internal
+ *
+ * @brief Flush the asynchronous writes of RPMsg RPC
+ *
+ * This function sends the coalesced writes and waits for the ack of all the
+ * asynchronous writes.
+ *
+ * @param rpc	Pointer to remoteproc procedure call data struct
+ *
+ * @return 0 for success, the first write error otherwise.
+ */
+int rpmsg_rpc_flush(struct rpmsg_rpc_data *rpc);
+
+/**
+ * @internal
+ *
+ * @brief Initialize and attach a read-ahead cache to a file
+ *
+ * When a read-ahead cache is attached to a file, _read() requests the data
+ * of the file in chunks of a RPMsg buffer payload, with as many requests in
+ * flight as chunks fit in the free space of the cache, and serves the reads
+ * from the cache. It suits files that are only read sequentially, such as
+ * configuration files or input streams. The cache is detached by _close()
+ * or by rpmsg_rpc_read_cache_release().
+ *
+ * @param rpc	Pointer to remoteproc procedure call data struct
+ * @param cache	Pointer to the read-ahead cache to initialize
+ * @param fd	File descriptor to read ahead
+ * @param buf	Ring buffer of the cache
+ * @param size	Size of the ring buffer, at least one chunk
+ *
+ * @return 0 for success, and negative value for failure.
+ */
+int rpmsg_rpc_read_cache_init(struct rpmsg_rpc_data *rpc,
+			      struct rpmsg_rpc_read_cache *cache,
+			      int fd, void *buf, uint32_t size);
+
+/**
+ * @internal
+ *
+ * @brief Detach a read-ahead cache from its file
+ *
+ * This function waits for the answer of the read requests in flight of the
+ * cache. The data read ahead and not consumed is dropped.
+ *
+ * @param rpc	Pointer to remoteproc procedure call data struct
+ * @param cache	Pointer to the read-ahead cache
+ */
+void rpmsg_rpc_read_cache_release(struct rpmsg_rpc_data *rpc,
+				  struct rpmsg_rpc_read_cache *cache);
+
 /**
  * @internal
  *
@@ -127,6 +400,105 @@ int rpmsg_rpc_send(struct rpmsg_rpc_data *rpc,
  */
 void rpmsg_set_default_rpc(struct rpmsg_rpc_data *rpc);
 
+/**
+ * @internal
+ *
+ * @brief Set the RPMsg RPC selection function
+ *
+ * The selection function returns the RPC data used for a file operation,
+ * so each thread or each file can use its own channel, e.g. with the
+ * thread local storage of the system. The file descriptor is -1 for
+ * _open(). If the function returns NULL, the default RPC data is used.
+ *
+ * @param select	Selection function, NULL to always use the default
+ */
+void rpmsg_set_rpc_select(rpmsg_rpc_select select);
+
+/**
+ * @brief Reposition the offset of a file
+ *
+ * @param fd		File descriptor
+ * @param offset	Offset, relative to whence
+ * @param whence	SEEK_SET, SEEK_CUR or SEEK_END
+ *
+ * The function is built in its own object file, so that the _lseek() of a
+ * BSP is linked instead of it.
+ *
+ * @return The resulting offset, -EOVERFLOW if it does not fit in off_t, or
+ * negative value for failure.
+ */
+off_t _lseek(int fd, off_t offset, int whence);
+
+/**
+ * @brief Read from a file at an offset
+ *
+ * The offset of the file is not changed.
+ *
+ * @param fd		File descriptor
+ * @param buffer	Buffer to store the data read
+ * @param buflen	Number of bytes to read
+ * @param offset	Offset in the file
+ *
+ * @return Number of bytes read, or negative value for failure.
+ */
+int _pread(int fd, char *buffer, int buflen, off_t offset);
+
+/**
+ * @brief Write to a file at an offset
+ *
+ * The offset of the file is not changed.
+ *
+ * @param fd		File descriptor
+ * @param ptr		Data to write
+ * @param len		Number of bytes to write
+ * @param offset	Offset in the file
+ *
+ * @return Number of bytes written, or negative value for failure.
+ */
+int _pwrite(int fd, const char *ptr, int len, off_t offset);
+
+/**
+ * @brief Read from a file into several buffers
+ *
+ * The data of a READV answer is scattered in the vectors in order. Less
+ * data than the total length of the vectors may be returned.
+ *
+ * @param fd		File descriptor
+ * @param iov		Vectors to store the data read
+ * @param iovcnt	Number of vectors
+ *
+ * @return Number of bytes read, or negative value for failure.
+ */
+int _readv(int fd, const struct rpmsg_rpc_iovec *iov, int iovcnt);
+
+/**
+ * @brief Write to a file from several buffers
+ *
+ * The vectors are gathered in WRITEV requests, or in the TX buffer of the
+ * asynchronous writes, see rpmsg_rpc_set_write_mode().
+ *
+ * @param fd		File descriptor
+ * @param iov		Vectors of the data to write
+ * @param iovcnt	Number of vectors
+ *
+ * @return Number of bytes written, or negative value for failure.
+ */
+int _writev(int fd, const struct rpmsg_rpc_iovec *iov, int iovcnt);
+
+/**
+ * @brief Get the status of a file
+ *
+ * Only the st_mode and st_size fields are set, the other ones are 0. The
+ * function is built in its own object file, so that the _fstat() of a BSP is
+ * linked instead of it.
+ *
+ * @param fd	File descriptor
+ * @param st	Pointer to the status to fill
+ *
+ * @return 0 for success, and negative value for failure.
+ */
+int _fstat(int fd, struct stat *st);
+
 #if defined __cplusplus
 }
 #endif
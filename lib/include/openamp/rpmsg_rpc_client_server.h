@@ -9,7 +9,11 @@
 #define RPMSG_RPC_CLIENT_SERVER_H
 
 #include <openamp/open_amp.h>
+#include <metal/atomic.h>
 #include <metal/compiler.h>
+#include <metal/condition.h>
+#include <metal/mutex.h>
+#include <metal/spinlock.h>
 
 #if defined __cplusplus
 extern "C" {
@@ -17,8 +21,16 @@ extern "C" {
 
 #define RPMSG_RPC_OK		0
 #define RPMSG_RPC_INVALID_ID	(-1L)
+#define RPMSG_RPC_BUSY		(-2L)
 #define RPMSG_RPC_SERVICE_NAME "rpmsg-rpc"
 
+/*
+ * Pipelined requests start with a sequence tag with this flag set, their
+ * answers carry the tag in place of the service ID. Service IDs must not
+ * have it set.
+ */
+#define RPMSG_RPC_SEQ_FLAG	0x80000000UL
+
 /* RPMSG_BUFFER_SIZE = 512
  * sizeof(struct rpmsg_hdr) = 16
  * RPMSG_BUFFER_SIZE - sizeof(struct rpmsg_hdr) - 1 = 495
@@ -33,6 +45,11 @@ struct rpmsg_rpc_svr;
 typedef void (*rpmsg_rpc_shutdown_cb)(struct rpmsg_rpc_clt *rpc);
 typedef void (*app_cb)(struct rpmsg_rpc_clt *rpc, int status, void *data,
 		       size_t len);
+/*
+ * The request is passed in place in the RPMsg RX buffer, it is valid until the
+ * callback returns unless the service holds it with
+ * rpmsg_rpc_server_hold_request().
+ */
 typedef int (*rpmsg_rpc_syscall_cb)(void *data, struct rpmsg_rpc_svr *rpcs);
 
 /**
@@ -47,7 +64,16 @@ struct rpmsg_rpc_request {
 	unsigned char params[MAX_BUF_LEN];
 };
 
-/** @brief RPC request message */
+/** @brief Pipelined RPC request message */
+struct rpmsg_rpc_seq_request {
+	/** Sequence tag, with RPMSG_RPC_SEQ_FLAG set */
+	uint32_t seq;
+
+	/** Request */
+	struct rpmsg_rpc_request req;
+};
+
+/** @brief RPC answer message */
 METAL_PACKED_BEGIN
 struct rpmsg_rpc_answer {
 	/** Service ID */
@@ -78,6 +104,120 @@ struct rpmsg_rpc_client_services {
 	app_cb cb;
 };
 
+/** @brief Service ID lookup modes */
+enum rpmsg_rpc_index_mode {
+	/** Linear scan of the services table */
+	RPMSG_RPC_INDEX_LINEAR,
+	/** Services table entry i serves ID base + i */
+	RPMSG_RPC_INDEX_DIRECT,
+	/** Jump table of the services table entries from ID base */
+	RPMSG_RPC_INDEX_DENSE,
+	/** Binary search in the services table sorted by ID */
+	RPMSG_RPC_INDEX_SORTED,
+};
+
+/**
+ * @brief Service ID lookup index
+ *
+ * Built when the client or server is initialized, the lookup does not depend
+ * on the number of services except for sparse IDs which are binary searched.
+ */
+struct rpmsg_rpc_index {
+	/** Jump table of the entry index + 1, or entry indexes sorted by ID */
+	unsigned short *slots;
+
+	/** Lowest service ID */
+	uint32_t base;
+
+	/** Number of slots */
+	unsigned int num;
+
+	/** Lookup mode */
+	enum rpmsg_rpc_index_mode mode;
+};
+
+/** @brief Pipelined RPC call */
+struct rpmsg_rpc_call {
+	/** Sequence tag of the call, 0 when the call is free */
+	uint32_t seq;
+
+	/** Service ID */
+	uint32_t id;
+
+	/** Set if the answer is kept for rpmsg_rpc_client_complete() */
+	int handle;
+
+	/** Buffer for the answer params */
+	void *resp;
+
+	/** Size of the answer buffer */
+	size_t resp_len;
+
+	/** Status of the answer */
+	int status;
+
+	/** Length of the answer params */
+	size_t len;
+
+	/** Set when the answer has been received */
+	atomic_int done;
+};
+
+/** @brief Out-of-band RPC buffer descriptor */
+struct rpmsg_rpc_shm_desc {
+	/** Offset of the buffer in the shared memory region */
+	uint32_t offset;
+
+	/** Length of the buffer */
+	uint32_t len;
+};
+
+/**
+ * @brief Out-of-band RPC shared memory region
+ *
+ * Large RPC arguments and results are passed in this region instead of the
+ * RPMsg buffers, the RPC messages only carry their descriptors. Both sides use
+ * the same region, e.g. a carveout of the resource table. The descriptors hold
+ * offsets in the region, so each side can map it at a different address.
+ */
+struct rpmsg_rpc_shm {
+	/** Shared memory region */
+	struct metal_io_region *io;
+
+	/** Size of the allocation blocks, 0 if this side does not allocate */
+	size_t block_size;
+
+	/** Number of allocation blocks */
+	unsigned int num_blocks;
+
+	/** Bitmap of the allocated blocks */
+	unsigned long *bitmap;
+
+	/** Lock of the allocation bitmap */
+	struct metal_spinlock lock;
+};
+
+/** @brief Request served by the server workers */
+struct rpmsg_rpc_work {
+	/** Held RX buffer of the request, NULL when the work is free */
+	void *rxbuf;
+
+	/** Request */
+	struct rpmsg_rpc_request *req;
+
+	/** Service of the request */
+	const struct rpmsg_rpc_services *service;
+
+	/** Sequence tag of a pipelined request, else 0 */
+	uint32_t seq;
+
+	/** Queuing order of the request */
+	unsigned int ticket;
+
+	/** Set once a worker serves the request */
+	int busy;
+};
+
 /**
  * @brief Server remote procedure call data
  *
@@ -92,6 +232,39 @@ struct rpmsg_rpc_svr {
 
 	/** Number of services */
 	unsigned int n_services;
+
+	/** Service ID lookup index */
+	struct rpmsg_rpc_index index;
+
+	/** Sequence tag of the request being served, 0 if not pipelined */
+	uint32_t seq;
+
+	/** Server of a worker handle, NULL for the server itself */
+	struct rpmsg_rpc_svr *server;
+
+	/** Request served by a worker handle, NULL for the server itself */
+	struct rpmsg_rpc_work *work;
+
+	/** Out-of-band shared memory region, NULL if not used */
+	struct rpmsg_rpc_shm *shm;
+
+	/** Works table, NULL if the services run in the RX callback */
+	struct rpmsg_rpc_work *works;
+
+	/** Number of works */
+	unsigned int n_works;
+
+	/** Ticket of the next queued request */
+	unsigned int next_ticket;
+
+	/** Set to stop the workers */
+	int works_stop;
+
+	/** Lock of the works table */
+	metal_mutex_t works_lock;
+
+	/** Condition signalled when a request is queued */
+	struct metal_condition works_cond;
 };
 
 /**
@@ -112,6 +285,24 @@ struct rpmsg_rpc_clt {
 
 	/** Number of services */
 	unsigned int n_services;
+
+	/** Service ID lookup index */
+	struct rpmsg_rpc_index index;
+
+	/** Out-of-band shared memory region, NULL if not used */
+	struct rpmsg_rpc_shm *shm;
+
+	/** Pipelined calls table, NULL if the requests are not pipelined */
+	struct rpmsg_rpc_call *calls;
+
+	/** Number of pipelined calls */
+	unsigned int n_calls;
+
+	/** Next sequence tag */
+	uint32_t next_seq;
+
+	/** Lock of the pipelined calls table */
+	struct metal_spinlock lock;
 };
 
 /**
@@ -148,6 +339,24 @@ int rpmsg_rpc_client_init(struct rpmsg_rpc_clt *rpc,
 			  const struct rpmsg_rpc_client_services *services,
 			  int len);
 
+/**
+ * @internal
+ *
+ * @brief Enable pipelined RPMsg remote procedure calls
+ *
+ * Once enabled, every request of the client is tagged with a sequence number
+ * and up to num calls can be in flight, the answers are matched to the
+ * requests whatever their order. The server must support pipelined requests.
+ *
+ * @param rpc	Pointer to the client remote procedure call data
+ * @param calls	Pointer to the calls table
+ * @param num	Number of calls in the table
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_client_init_calls(struct rpmsg_rpc_clt *rpc,
+				struct rpmsg_rpc_call *calls, unsigned int num);
+
 /**
  * @internal
  *
@@ -167,11 +376,80 @@ int rpmsg_rpc_server_init(struct rpmsg_rpc_svr *rpcs, struct rpmsg_device *rdev,
 			  const struct rpmsg_rpc_services *services, int len,
 			  rpmsg_ns_unbind_cb rpmsg_service_server_unbind);
 
+/**
+ * @internal
+ *
+ * @brief Release RPMsg rpc for server
+ *
+ * This function destroys the endpoint and releases the services index and
+ * the workers. The workers must be stopped with
+ * rpmsg_rpc_server_stop_workers() and have returned from
+ * rpmsg_rpc_server_work() before.
+ *
+ * @param rpcs	Pointer to the server rpc
+ */
+void rpmsg_rpc_server_release(struct rpmsg_rpc_svr *rpcs);
+
+/**
+ * @internal
+ *
+ * @brief Serve the requests with workers
+ *
+ * Once enabled, the RX callback holds the RX buffer of each request and
+ * queues it in the works table instead of running its service. The services
+ * run in the threads calling rpmsg_rpc_server_work(), so a slow service does
+ * not block the RX processing of the RPMsg device. The requests received when
+ * all works are in use are answered with the RPMSG_RPC_BUSY status, the table
+ * should have as many works as RX buffers to avoid it.
+ *
+ * @param rpcs		Pointer to the server rpc
+ * @param works		Pointer to the works table
+ * @param num		Number of works in the table
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_server_init_workers(struct rpmsg_rpc_svr *rpcs,
+				  struct rpmsg_rpc_work *works,
+				  unsigned int num);
+
+/**
+ * @internal
+ *
+ * @brief Serve one request as a worker
+ *
+ * This function waits for a queued request, runs its service and releases
+ * its RX buffer. Each worker thread calls it in a loop until it fails.
+ *
+ * The service is passed a handle of the server bound to its request rather
+ * than the server itself, so that its answers are tagged for this request.
+ * The handle is only valid until the service callback returns.
+ *
+ * @param rpcs	Pointer to the server rpc
+ *
+ * @return 0 once a request is served, -EPIPE when the workers are stopped and
+ *	   no request is queued, other negative value for failure.
+ */
+int rpmsg_rpc_server_work(struct rpmsg_rpc_svr *rpcs);
+
+/**
+ * @internal
+ *
+ * @brief Stop the server workers
+ *
+ * The workers serve the queued requests then rpmsg_rpc_server_work() fails.
+ *
+ * @param rpcs	Pointer to the server rpc
+ */
+void rpmsg_rpc_server_stop_workers(struct rpmsg_rpc_svr *rpcs);
+
 /**
  * @internal
  *
  * @brief Request RPMsg RPC call
  *
+ * When the calls are pipelined, the answer is passed to the service callback
+ * of the client as for rpmsg_rpc_client_call() without call handle.
+ *
  * @param rpc			Pointer to client remoteproc procedure call
  *				data
  * @param rpc_id		Function id
@@ -184,6 +462,87 @@ int rpmsg_rpc_client_send(struct rpmsg_rpc_clt *rpc,
 			  uint32_t rpc_id, void *request_param,
 			  size_t req_param_size);
 
+/**
+ * @internal
+ *
+ * @brief Issue a pipelined RPMsg RPC call
+ *
+ * The call returns as soon as the request is sent. If call is NULL, the
+ * answer is passed to the service callback of the client. Else the answer
+ * params are stored in resp and the call must be completed with
+ * rpmsg_rpc_client_complete().
+ *
+ * @param rpc			Pointer to client remoteproc procedure call
+ *				data
+ * @param rpc_id		Function id
+ * @param request_param		Pointer to request buffer
+ * @param req_param_size	Length of the request data
+ * @param resp			Pointer to the answer buffer
+ * @param resp_len		Length of the answer buffer
+ * @param call			Pointer to store the call handle, or NULL
+ *
+ * @return Length of the sent request, negative value for failure.
+ */
+int rpmsg_rpc_client_call(struct rpmsg_rpc_clt *rpc, uint32_t rpc_id,
+			  void *request_param, size_t req_param_size,
+			  void *resp, size_t resp_len,
+			  struct rpmsg_rpc_call **call);
+
+/**
+ * @internal
+ *
+ * @brief Issue a pipelined RPMsg RPC call built in place
+ *
+ * Same as rpmsg_rpc_client_call() for a request built in the buffer returned
+ * by rpmsg_rpc_client_get_tx_buffer().
+ *
+ * @param rpc			Pointer to client remoteproc procedure call
+ *				data
+ * @param params		Request parameters returned by
+ *				rpmsg_rpc_client_get_tx_buffer()
+ * @param req_param_size	Length of the request data
+ * @param resp			Pointer to the answer buffer
+ * @param resp_len		Length of the answer buffer
+ * @param call			Pointer to store the call handle, or NULL
+ *
+ * @return Length of the sent request, negative value for failure.
+ */
+int rpmsg_rpc_client_call_nocopy(struct rpmsg_rpc_clt *rpc, void *params,
+				 size_t req_param_size, void *resp,
+				 size_t resp_len, struct rpmsg_rpc_call **call);
+
+/**
+ * @internal
+ *
+ * @brief Check if a pipelined RPMsg RPC call is answered
+ *
+ * @param call	Call handle
+ *
+ * @return 1 if the answer has been received, else 0.
+ */
+static inline int rpmsg_rpc_call_done(struct rpmsg_rpc_call *call)
+{
+	return atomic_load(&call->done);
+}
+
+/**
+ * @internal
+ *
+ * @brief Complete a pipelined RPMsg RPC call
+ *
+ * The call handle is released when the answer has been received.
+ *
+ * @param rpc		Pointer to client remoteproc procedure call data
+ * @param call		Call handle
+ * @param status	Pointer to store the status of the answer
+ *
+ * @return Length of the answer params stored in the answer buffer, -EAGAIN
+ *	   if the answer has not been received yet, other negative value for
+ *	   failure.
+ */
+int rpmsg_rpc_client_complete(struct rpmsg_rpc_clt *rpc,
+			      struct rpmsg_rpc_call *call, int *status);
+
 /**
  * @internal
  *
@@ -203,6 +562,263 @@ int rpmsg_rpc_server_send(struct rpmsg_rpc_svr *rpcs, uint32_t rpc_id,
 			  int status, void *request_param,
 			  size_t param_size);
 
+/**
+ * @internal
+ *
+ * @brief Get a TX buffer to build a RPC request in place
+ *
+ * The request ID is set in the RPMsg TX buffer, the caller writes the request
+ * parameters at the returned address and sends them with
+ * rpmsg_rpc_client_send_nocopy(), with no intermediate copy.
+ *
+ * @param rpc		Pointer to client remoteproc procedure call data
+ * @param rpc_id	Function id
+ * @param len		Pointer to store the size available for the parameters
+ * @param wait		Boolean, wait or not for buffer to become available
+ *
+ * @return Address of the request parameters, NULL on failure.
+ */
+void *rpmsg_rpc_client_get_tx_buffer(struct rpmsg_rpc_clt *rpc,
+				     uint32_t rpc_id, uint32_t *len, int wait);
+
+/**
+ * @internal
+ *
+ * @brief Send a RPC request built in place
+ *
+ * On success the buffer is owned by the RPMsg device and must not be touched
+ * anymore. On failure it must be sent again or released with
+ * rpmsg_rpc_client_release_tx_buffer().
+ *
+ * @param rpc			Pointer to client remoteproc procedure call
+ *				data
+ * @param params		Request parameters returned by
+ *				rpmsg_rpc_client_get_tx_buffer()
+ * @param req_param_size	Length of the request data
+ *
+ * @return Length of the sent request, negative value for failure.
+ */
+int rpmsg_rpc_client_send_nocopy(struct rpmsg_rpc_clt *rpc, void *params,
+				 size_t req_param_size);
+
+/**
+ * @internal
+ *
+ * @brief Release a RPC request TX buffer which has not been sent
+ *
+ * @param rpc		Pointer to client remoteproc procedure call data
+ * @param params	Request parameters returned by
+ *			rpmsg_rpc_client_get_tx_buffer()
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_client_release_tx_buffer(struct rpmsg_rpc_clt *rpc,
+				       void *params);
+
+/**
+ * @internal
+ *
+ * @brief Get a TX buffer to build a RPC answer in place
+ *
+ * The answer ID is set in the RPMsg TX buffer, the service writes its answer
+ * parameters at the returned address and sends them with
+ * rpmsg_rpc_server_send_nocopy(), with no intermediate copy.
+ *
+ * While a pipelined request is served, the answer is tagged with its
+ * sequence. A service which answers after its callback has returned passes
+ * the server and the ID returned by rpmsg_rpc_server_answer_id() for its
+ * request.
+ *
+ * @param rpcs		Pointer to server rpc data
+ * @param rpc_id	Function id
+ * @param len		Pointer to store the size available for the parameters
+ * @param wait		Boolean, wait or not for buffer to become available
+ *
+ * @return Address of the answer parameters, NULL on failure.
+ */
+void *rpmsg_rpc_server_get_tx_buffer(struct rpmsg_rpc_svr *rpcs,
+				     uint32_t rpc_id, uint32_t *len, int wait);
+
+/**
+ * @internal
+ *
+ * @brief Hold the RX buffer of the request being served
+ *
+ * This function can only be called from the service callback. The request
+ * stays valid until the returned RX buffer is released with
+ * rpmsg_release_rx_buffer() on the server endpoint, after the worker has
+ * released its own hold for a request served by a worker.
+ *
+ * @param rpcs		Pointer to server rpc data
+ * @param data		Request passed to the service callback
+ *
+ * @return The RX buffer to release.
+ */
+void *rpmsg_rpc_server_hold_request(struct rpmsg_rpc_svr *rpcs, void *data);
+
+/**
+ * @internal
+ *
+ * @brief Get the ID to answer a request
+ *
+ * This function can only be called while the request is served, from the
+ * service callback.
+ *
+ * @param rpcs		Pointer to server rpc data
+ * @param data		Request passed to the service callback
+ *
+ * @return The sequence tag of a pipelined request, else its function id.
+ */
+uint32_t rpmsg_rpc_server_answer_id(struct rpmsg_rpc_svr *rpcs, void *data);
+
+/**
+ * @internal
+ *
+ * @brief Send a RPC answer built in place
+ *
+ * On success the buffer is owned by the RPMsg device and must not be touched
+ * anymore. On failure it must be sent again or released with
+ * rpmsg_rpc_server_release_tx_buffer().
+ *
+ * @param rpcs		Pointer to server rpc data
+ * @param params	Answer parameters returned by
+ *			rpmsg_rpc_server_get_tx_buffer()
+ * @param status	Status of rpc
+ * @param param_size	Length of the answer data
+ *
+ * @return Length of the sent answer, negative value for failure.
+ */
+int rpmsg_rpc_server_send_nocopy(struct rpmsg_rpc_svr *rpcs, void *params,
+				 int status, size_t param_size);
+
+/**
+ * @internal
+ *
+ * @brief Release a RPC answer TX buffer which has not been sent
+ *
+ * @param rpcs		Pointer to server rpc data
+ * @param params	Answer parameters returned by
+ *			rpmsg_rpc_server_get_tx_buffer()
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_server_release_tx_buffer(struct rpmsg_rpc_svr *rpcs,
+				       void *params);
+
+/**
+ * @internal
+ *
+ * @brief Initialize an out-of-band RPC shared memory region
+ *
+ * The side which allocates the argument and result buffers splits the region
+ * in blocks of block_size bytes. The other side only accesses the buffers of
+ * the descriptors it receives and passes 0.
+ *
+ * @param shm		Pointer to the out-of-band shared memory
+ * @param io		Shared memory region
+ * @param block_size	Size of the allocation blocks, 0 for no allocation
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_shm_init(struct rpmsg_rpc_shm *shm, struct metal_io_region *io,
+		       size_t block_size);
+
+/**
+ * @internal
+ *
+ * @brief Release an out-of-band RPC shared memory region
+ *
+ * @param shm	Pointer to the out-of-band shared memory
+ */
+void rpmsg_rpc_shm_release(struct rpmsg_rpc_shm *shm);
+
+/**
+ * @internal
+ *
+ * @brief Allocate an out-of-band RPC buffer
+ *
+ * @param shm	Pointer to the out-of-band shared memory
+ * @param len	Length of the buffer
+ * @param desc	Pointer to store the descriptor to send to the other side
+ *
+ * @return Address of the buffer, NULL on failure.
+ */
+void *rpmsg_rpc_shm_alloc(struct rpmsg_rpc_shm *shm, size_t len,
+			  struct rpmsg_rpc_shm_desc *desc);
+
+/**
+ * @internal
+ *
+ * @brief Free an out-of-band RPC buffer
+ *
+ * @param shm	Pointer to the out-of-band shared memory
+ * @param desc	Descriptor of the buffer
+ */
+void rpmsg_rpc_shm_free(struct rpmsg_rpc_shm *shm,
+			const struct rpmsg_rpc_shm_desc *desc);
+
+/**
+ * @internal
+ *
+ * @brief Access the out-of-band RPC buffer of a received descriptor
+ *
+ * The descriptor is checked against the shared memory region and the buffer
+ * is invalidated from the data cache if enabled.
+ *
+ * @param shm	Pointer to the out-of-band shared memory
+ * @param desc	Descriptor of the buffer
+ *
+ * @return Address of the buffer, NULL if the descriptor is invalid.
+ */
+void *rpmsg_rpc_shm_data(struct rpmsg_rpc_shm *shm,
+			 const struct rpmsg_rpc_shm_desc *desc);
+
+/**
+ * @internal
+ *
+ * @brief Hand an out-of-band RPC buffer over to the other side
+ *
+ * This function flushes the buffer from the data cache if enabled, it is
+ * called once the buffer is written and before its descriptor is sent.
+ *
+ * @param shm	Pointer to the out-of-band shared memory
+ * @param desc	Descriptor of the buffer
+ *
+ * @return 0 for success, and negative value for failure
+ */
+int rpmsg_rpc_shm_flush(struct rpmsg_rpc_shm *shm,
+			const struct rpmsg_rpc_shm_desc *desc);
+
+/**
+ * @internal
+ *
+ * @brief Set the out-of-band shared memory of a RPC client
+ *
+ * @param rpc	Pointer to client remoteproc procedure call data
+ * @param shm	Pointer to the out-of-band shared memory, NULL to unset it
+ */
+static inline void rpmsg_rpc_client_set_shm(struct rpmsg_rpc_clt *rpc,
+					    struct rpmsg_rpc_shm *shm)
+{
+	rpc->shm = shm;
+}
+
+/**
+ * @internal
+ *
+ * @brief Set the out-of-band shared memory of a RPC server
+ *
+ * The services access it from their rpcs argument.
+ *
+ * @param rpcs	Pointer to server rpc data
+ * @param shm	Pointer to the out-of-band shared memory, NULL to unset it
+ */
+static inline void rpmsg_rpc_server_set_shm(struct rpmsg_rpc_svr *rpcs,
+					    struct rpmsg_rpc_shm *shm)
+{
+	rpcs->shm = shm;
+}
+
 #if defined __cplusplus
 }
 #endif
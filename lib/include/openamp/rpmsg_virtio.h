@@ -27,8 +27,18 @@ extern "C" {
 #define RPMSG_BUFFER_SIZE	(512)
 #endif
 
+/* Maximum number of TX/RX virtqueue pairs of a RPMsg virtio device */
+#ifndef RPMSG_VIRTIO_MAX_QPAIRS
+#define RPMSG_VIRTIO_MAX_QPAIRS	(1)
+#endif
+
+#if RPMSG_VIRTIO_MAX_QPAIRS < 1 || RPMSG_VIRTIO_MAX_QPAIRS > 256
+#error "RPMSG_VIRTIO_MAX_QPAIRS must be between 1 and 256"
+#endif
+
 /* The feature bitmap for virtio rpmsg */
 #define VIRTIO_RPMSG_F_NS	0 /* RP supports name service notifications */
+#define VIRTIO_RPMSG_F_QPAIRS	1 /* RP supports several virtqueue pairs */
 
 #if defined(VIRTIO_USE_DCACHE)
 #define BUFFER_FLUSH(x, s)		metal_cache_flush(x, s)
@@ -41,6 +51,10 @@ extern "C" {
 /* Callback handler for rpmsg virtio service */
 typedef int (*rpmsg_virtio_notify_wait_cb)(struct rpmsg_device *rdev, uint32_t id);
 
+/* Callback handler returning the queue pair used to send from an address */
+typedef unsigned int (*rpmsg_virtio_steer_cb)(struct rpmsg_device *rdev,
+					      uint32_t src);
+
 /** @brief Shared memory pool used for RPMsg buffers */
 struct rpmsg_virtio_shm_pool {
 	/** Base address of the memory pool */
@@ -53,6 +67,17 @@ struct rpmsg_virtio_shm_pool {
 	size_t size;
 };
 
+/**
+ * @brief Virtio config space of a RPMsg device
+ *
+ * It is only used with the \ref VIRTIO_RPMSG_F_QPAIRS feature, the vdev
+ * resource must then reserve config_len bytes for it.
+ */
+struct rpmsg_virtio_dev_config {
+	/** Number of TX/RX virtqueue pairs used, written by the host */
+	uint32_t num_qpairs;
+};
+
 /**
  * @brief Configuration of RPMsg device based on virtio
  *
@@ -68,6 +93,35 @@ struct rpmsg_virtio_config {
 
 	/** The flag for splitting shared memory pool to TX and RX */
 	bool split_shpool;
+
+	/**
+	 * Number of TX/RX virtqueue pairs, 0 is handled as 1. It is limited
+	 * to the vring pairs of the virtio device, and only more than 1 is
+	 * used if the remote supports \ref VIRTIO_RPMSG_F_QPAIRS.
+	 */
+	unsigned int num_qpairs;
+};
+
+/** @brief Pair of RPMsg virtio receive and send virtqueues */
+struct rpmsg_virtio_qpair {
+	/** Pointer to receive virtqueue */
+	struct virtqueue *rvq;
+
+	/** Pointer to send virtqueue */
+	struct virtqueue *svq;
+
+	/**
+	 * Mutex lock for the virtqueues of the pair, the RPMsg device lock is
+	 * used instead when the device has a single pair
+	 */
+	metal_mutex_t lock;
+
+	/**
+	 * RPMsg buffer reclaimer that contains buffers released by the
+	 * \ref rpmsg_virtio_release_tx_buffer function, the reclaimer of the
+	 * RPMsg virtio device is used instead for the first pair
+	 */
+	struct metal_list reclaimer;
 };
 
 /** @brief Representation of a RPMsg device based on virtio */
@@ -81,10 +135,10 @@ struct rpmsg_virtio_device {
 	/** Pointer to the virtio device */
 	struct virtio_device *vdev;
 
-	/** Pointer to receive virtqueue */
+	/** Pointer to receive virtqueue of the first queue pair */
 	struct virtqueue *rvq;
 
-	/** Pointer to send virtqueue */
+	/** Pointer to send virtqueue of the first queue pair */
 	struct virtqueue *svq;
 
 	/** Pointer to the shared buffer I/O region */
@@ -93,17 +147,32 @@ struct rpmsg_virtio_device {
 	/** Pointer to the shared buffers pool */
 	struct rpmsg_virtio_shm_pool *shpool;
 
+	/** Mutex lock for the shared buffers pool with several queue pairs */
+	metal_mutex_t shpool_lock;
+
 	/**
-	 * RPMsg buffer reclaimer that contains buffers released by the
-	 * \ref rpmsg_virtio_release_tx_buffer function
+	 * RPMsg buffer reclaimer of the first queue pair that contains buffers
+	 * released by the \ref rpmsg_virtio_release_tx_buffer function
 	 */
 	struct metal_list reclaimer;
 
+	/** Virtqueue pairs, messages are steered on them by source address */
+	struct rpmsg_virtio_qpair qpairs[RPMSG_VIRTIO_MAX_QPAIRS];
+
+	/** Number of virtqueue pairs in use */
+	unsigned int num_qpairs;
+
 	/**
 	 * Callback handler for rpmsg virtio service, called when service
 	 * can't get tx buffer
 	 */
 	rpmsg_virtio_notify_wait_cb notify_wait_cb;
+
+	/**
+	 * Callback handler selecting the queue pair used to send from an
+	 * address, the address modulo the number of pairs is used if not set
+	 */
+	rpmsg_virtio_steer_cb steer_cb;
 };
 
 #define RPMSG_REMOTE	VIRTIO_DEV_DEVICE
@@ -121,6 +190,22 @@ static inline void rpmsg_virtio_set_wait_cb(struct rpmsg_virtio_device *rvdev,
 	rvdev->notify_wait_cb = notify_wait_cb;
 }
 
+/**
+ * @brief Set the callback selecting the TX queue pair of a source address.
+ *
+ * All the messages sent from an endpoint address go through the same queue
+ * pair, which keeps them ordered. The callback should be set before the
+ * endpoints start sending.
+ *
+ * @param rvdev		Pointer to rpmsg virtio device.
+ * @param steer_cb	Callback handler returning a queue pair index.
+ */
+static inline void rpmsg_virtio_set_steer_cb(struct rpmsg_virtio_device *rvdev,
+					     rpmsg_virtio_steer_cb steer_cb)
+{
+	rvdev->steer_cb = steer_cb;
+}
+
 /**
  * @brief Get rpmsg virtio device role.
  *
@@ -210,7 +295,9 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
  * Remote side:
  * This API will not return until the driver ready is set by the host side.
  * Sizes of virtio data buffers are set by the host side. Values passed in the
- * configuration structure have no effect.
+ * configuration structure have no effect. The number of virtqueue pairs is
+ * set by the host in the config space with \ref VIRTIO_RPMSG_F_QPAIRS, a
+ * single pair is used without it.
  *
  * @param rvdev		Pointer to the rpmsg virtio device
  * @param vdev		Pointer to the virtio device
@@ -72,6 +72,24 @@ extern "C" {
 
 #define VIRTIO_ENABLED(option) (option == 1)
 
+#if defined(VIRTIO_DRIVER_SUPPORT) && defined(VIRTIO_DEVICE_SUPPORT) && \
+	VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT) != VIRTIO_ENABLED(VIRTIO_DEVICE_SUPPORT)
+/*
+ * Single role build: the role is fixed at compile time, so that the role
+ * tests are resolved by the compiler and the virtqueue fast paths have no
+ * role branches.
+ */
+#define VIRTIO_ROLE_IS_DRIVER(vdev) \
+	((void)(vdev), VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT))
+#define VIRTIO_ROLE_IS_DEVICE(vdev) \
+	((void)(vdev), VIRTIO_ENABLED(VIRTIO_DEVICE_SUPPORT))
+/* The role tests ignore vdev->role, a vdev of the other role is rejected */
+#define VIRTIO_ROLE_IS_SUPPORTED(role) \
+	((role) == (VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT) ? \
+		    VIRTIO_DEV_DRIVER : VIRTIO_DEV_DEVICE))
+#else
+#define VIRTIO_ROLE_IS_SUPPORTED(role) ((role) <= VIRTIO_DEV_DEVICE)
+
 #ifdef VIRTIO_DRIVER_SUPPORT
 #define VIRTIO_ROLE_IS_DRIVER(vdev) \
 	(VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT) && ((vdev)->role) == VIRTIO_DEV_DRIVER)
@@ -88,6 +106,8 @@ extern "C" {
 #define VIRTIO_ROLE_IS_DEVICE(vdev) ((vdev)->role == VIRTIO_DEV_DEVICE)
 #endif
 
+#endif
+
 /** @brief Virtio device identifier. */
 struct virtio_device_id {
 	/** Virtio subsystem device ID. */
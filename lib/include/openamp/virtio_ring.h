@@ -178,23 +178,67 @@ struct vring {
 #define vring_used_event(vr)	((vr)->avail->ring[(vr)->num])
 #define vring_avail_event(vr)	((vr)->used->ring[(vr)->num].event)
 
-static inline int vring_size(unsigned int num, unsigned long align)
+/**
+ * @brief Get the size of a vring with the cache-line-aware layout
+ *
+ * The standard layout only aligns the used ring on \ref align, so when the
+ * alignment is smaller than a cache line, the tail of the available ring
+ * (written by the driver) and the head of the used ring (written by the
+ * device) can share a cache line. On non-coherent links, this leads to
+ * false sharing and to flushes of one side overwriting the updates of the
+ * other side.
+ *
+ * With a non-zero cache line size, the used ring is aligned on
+ * max(align, cache_line) and the vring size is rounded up to a multiple
+ * of the cache line size, so that no cache line holds both driver-owned
+ * and device-owned fields. The vring base address is expected to be
+ * cache line aligned.
+ *
+ * @param num		Number of descriptors, power of 2
+ * @param align		Alignment of the used ring
+ * @param cache_line	Cache line size (power of 2), 0 for the standard layout
+ *
+ * @return Size of the vring in bytes
+ */
+static inline int vring_size_cache_aligned(unsigned int num,
+					   unsigned long align,
+					   unsigned long cache_line)
 {
 	int size;
 
+	if (cache_line > align)
+		align = cache_line;
+
 	size = num * sizeof(struct vring_desc);
 	size += sizeof(struct vring_avail) + (num * sizeof(uint16_t)) +
 	    sizeof(uint16_t);
 	size = (size + align - 1) & ~(align - 1);
 	size += sizeof(struct vring_used) +
 	    (num * sizeof(struct vring_used_elem)) + sizeof(uint16_t);
+	if (cache_line)
+		size = (size + cache_line - 1) & ~(cache_line - 1);
 
 	return size;
 }
 
+/**
+ * @brief Initialize a vring with the cache-line-aware layout
+ *
+ * @param vr		Pointer to the vring structure to initialize
+ * @param num		Number of descriptors, power of 2
+ * @param p		Vring base address
+ * @param align		Alignment of the used ring
+ * @param cache_line	Cache line size (power of 2), 0 for the standard layout
+ *
+ * @see vring_size_cache_aligned
+ */
 static inline void
-vring_init(struct vring *vr, unsigned int num, uint8_t *p, unsigned long align)
+vring_init_cache_aligned(struct vring *vr, unsigned int num, uint8_t *p,
+			 unsigned long align, unsigned long cache_line)
 {
+	if (cache_line > align)
+		align = cache_line;
+
 	vr->num = num;
 	vr->desc = (struct vring_desc *)p;
 	vr->avail = (struct vring_avail *)(p + num * sizeof(struct vring_desc));
@@ -203,6 +247,17 @@ vring_init(struct vring *vr, unsigned int num, uint8_t *p, unsigned long align)
 	      align - 1) & ~(align - 1));
 }
 
+static inline int vring_size(unsigned int num, unsigned long align)
+{
+	return vring_size_cache_aligned(num, align, 0);
+}
+
+static inline void
+vring_init(struct vring *vr, unsigned int num, uint8_t *p, unsigned long align)
+{
+	vring_init_cache_aligned(vr, num, p, align, 0);
+}
+
 /*
  * The following is used with VIRTIO_RING_F_EVENT_IDX.
  *
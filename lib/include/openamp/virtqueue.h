@@ -48,6 +48,46 @@ extern "C" {
 /* Support to suppress interrupt until specific index is reached. */
 #define VIRTIO_RING_F_EVENT_IDX        (1 << 29)
 
+/*
+ * Support for the cache-line-aware vring layout (see
+ * vring_size_cache_aligned()). This is an OpenAMP specific feature,
+ * a peer not aware of it does not acknowledge it and the standard
+ * layout is used.
+ */
+#define VIRTIO_RING_F_CACHE_ALIGNED    (1 << 26)
+
+/*
+ * The device uses the buffers in the same order in which they have been made
+ * available, as for VIRTIO_F_IN_ORDER in the virtio specification. That bit
+ * (35) can not be carried by the 32-bit features of the remoteproc vdev
+ * resource, so OpenAMP negotiates it as a ring feature.
+ *
+ * The driver then recycles the descriptors as a ring, and takes the used
+ * buffers from it without reading the used ids or walking the free chain.
+ * The device publishes a buffer consumed before an earlier one once the
+ * earlier ones are consumed too, its virtqueue must be allocated with a
+ * descriptor extra per ring entry to keep it meanwhile.
+ */
+#define VIRTIO_RING_F_IN_ORDER         (1 << 25)
+
+/*
+ * Check if the VIRTIO_RING_F_EVENT_IDX notification suppression is used.
+ * It can be fixed at build time with VIRTIO_EVENT_IDX_SUPPORT, to remove the
+ * run time feature tests from the virtqueue fast paths. The negotiated
+ * features are then checked against it when the virtqueue is created.
+ */
+#ifdef VIRTIO_EVENT_IDX_SUPPORT
+#define VQ_RING_EVENT_IDX(vq)	(VIRTIO_EVENT_IDX_SUPPORT == 1)
+#else
+#define VQ_RING_EVENT_IDX(vq) \
+	(((vq)->vq_dev->features & VIRTIO_RING_F_EVENT_IDX) != 0)
+#endif
+
+/* Cache line size used for the VIRTIO_RING_F_CACHE_ALIGNED vring layout */
+#ifndef VRING_CACHE_LINE_SIZE
+#define VRING_CACHE_LINE_SIZE          64
+#endif
+
 #if defined(VIRTIO_USE_DCACHE)
 #define VRING_FLUSH(x, s)		metal_cache_flush(x, s)
 #define VRING_INVALIDATE(x, s)		metal_cache_invalidate(x, s)
@@ -70,8 +110,14 @@ struct vq_desc_extra {
 	/** Pointer to first descriptor. */
 	void *cookie;
 
-	/** Number of chained descriptors. */
+	/**
+	 * Number of chained descriptors. In-order mode, device side: non-zero
+	 * while the consumed buffer waits for the previous ones.
+	 */
 	uint16_t ndescs;
+
+	/** In-order mode, device side: length of the consumed buffer. */
+	uint32_t used_len;
 };
 
 /** @brief Local virtio queue to manage a virtio ring for sending or receiving. */
@@ -124,6 +170,12 @@ struct virtqueue {
 	/** Last consumed descriptor in the available table, used by the consumer side. */
 	uint16_t vq_available_idx;
 
+	/**
+	 * In-order mode, driver side: head of the oldest descriptor chain not
+	 * returned by virtqueue_get_buffer() yet.
+	 */
+	uint16_t vq_desc_tail_idx;
+
 #ifdef VQUEUE_DEBUG
 	/** Debug counter for virtqueue reentrance check. */
 	bool vq_inuse;
@@ -131,7 +183,7 @@ struct virtqueue {
 
 	/**
 	 * Used by the host side during callback. Cookie holds the address of buffer received from
-	 * other side. Other fields in this structure are not used currently.
+	 * other side. The device side only uses it in in-order mode.
 	 */
 	struct vq_desc_extra vq_descx[0];
 };
@@ -147,8 +199,11 @@ struct vring_alloc_info {
 	/** Number of descriptors in the vring. */
 	uint16_t num_descs;
 
-	/** Padding */
-	uint16_t pad;
+	/**
+	 * Cache line size of the vring layout, 0 for the standard layout.
+	 * Both sides must agree on it, see \ref VIRTIO_RING_F_CACHE_ALIGNED.
+	 */
+	uint16_t cache_line;
 };
 
 typedef void (*vq_callback)(struct virtqueue *);
@@ -263,6 +318,9 @@ int virtqueue_add_buffer(struct virtqueue *vq, struct virtqueue_buf *buf_list,
  *
  * @brief Returns used buffers from VirtIO queue
  *
+ * If \ref VIRTIO_RING_F_IN_ORDER is negotiated, the buffers are returned in
+ * the order they were added.
+ *
  * @param vq	Pointer to VirtIO queue control block
  * @param len	Length of conumed buffer
  * @param idx	Index of the buffer
@@ -315,6 +373,9 @@ void *virtqueue_get_next_avail_buffer(struct virtqueue *vq, uint16_t idx,
  *
  * @brief Returns consumed buffer back to VirtIO queue
  *
+ * If \ref VIRTIO_RING_F_IN_ORDER is negotiated, a buffer consumed before one
+ * made available earlier is added to the used ring after it.
+ *
  * @param vq		Pointer to VirtIO queue control block
  * @param head_idx	Index of vring desc containing used buffer
  * @param len		Length of buffer
@@ -0,0 +1,527 @@
+/*-
+ * Copyright (c) 2011, Bryan Venteicher <bryanv@FreeBSD.org>
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef VIRTQUEUE_INLINE_H_
+#define VIRTQUEUE_INLINE_H_
+
+/**
+ * @internal
+ *
+ * @file virtqueue_inline.h
+ * @brief Inline implementation of the virtqueue hot path operations.
+ *
+ * The exported virtqueue API in virtqueue.c is built on top of these
+ * functions. Transports built with VQ_INLINE enabled call them directly to
+ * save a function call per buffer. Unlike the exported functions, the
+ * *_inline variants expect a valid virtqueue pointer.
+ */
+
+#include <openamp/virtio.h>
+#include <openamp/virtqueue.h>
+#include <metal/atomic.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/* Check if the buffers are used in the order they are made available */
+static inline bool virtqueue_ring_in_order(struct virtqueue *vq)
+{
+	return (vq->vq_dev->features & VIRTIO_RING_F_IN_ORDER) != 0;
+}
+
+/* Default implementation of P2V based on libmetal */
+static inline void *virtqueue_ring_phys_to_virt(struct virtqueue *vq,
+						metal_phys_addr_t phys)
+{
+	struct metal_io_region *io = vq->shm_io;
+
+	return metal_io_phys_to_virt(io, phys);
+}
+
+/* Default implementation of V2P based on libmetal */
+static inline metal_phys_addr_t virtqueue_ring_virt_to_phys(struct virtqueue *vq,
+							    void *buf)
+{
+	struct metal_io_region *io = vq->shm_io;
+
+	return metal_io_virt_to_phys(io, buf);
+}
+
+/*
+ *
+ * virtqueue_ring_add_buffer
+ *
+ */
+static inline uint16_t virtqueue_ring_add_buffer(struct virtqueue *vq,
+						 struct vring_desc *desc,
+						 uint16_t head_idx,
+						 struct virtqueue_buf *buf_list,
+						 int readable, int writable)
+{
+	struct vring_desc *dp;
+	int i, needed;
+	uint16_t idx;
+
+	(void)vq;
+
+	needed = readable + writable;
+
+	for (i = 0, idx = head_idx; i < needed; i++, idx = dp->next) {
+		VQASSERT(vq, idx != VQ_RING_DESC_CHAIN_END,
+			 "premature end of free desc chain");
+
+		/* CACHE: No need to invalidate desc because it is only written by driver */
+		dp = &desc[idx];
+		dp->addr = virtqueue_ring_virt_to_phys(vq, buf_list[i].buf);
+		dp->len = buf_list[i].len;
+		dp->flags = 0;
+
+		if (i < needed - 1)
+			dp->flags |= VRING_DESC_F_NEXT;
+
+		/*
+		 * Readable buffers are inserted  into vring before the
+		 * writable buffers.
+		 */
+		if (i >= readable)
+			dp->flags |= VRING_DESC_F_WRITE;
+
+		/*
+		 * Instead of flushing the whole desc region, we flush only the
+		 * single entry hopefully saving some cycles
+		 */
+		VRING_FLUSH(&desc[idx], sizeof(desc[idx]));
+
+	}
+
+	return idx;
+}
+
+/*
+ *
+ * virtqueue_ring_free_chain
+ *
+ */
+static inline void virtqueue_ring_free_chain(struct virtqueue *vq,
+					     uint16_t desc_idx)
+{
+	struct vring_desc *dp;
+	struct vq_desc_extra *dxp;
+
+	/* CACHE: desc is never written by remote, no need to invalidate */
+	VQ_RING_ASSERT_VALID_IDX(vq, desc_idx);
+	dp = &vq->vq_ring.desc[desc_idx];
+	dxp = &vq->vq_descx[desc_idx];
+
+	if (vq->vq_free_cnt == 0) {
+		VQ_RING_ASSERT_CHAIN_TERM(vq);
+	}
+
+	vq->vq_free_cnt += dxp->ndescs;
+	dxp->ndescs--;
+
+	if ((dp->flags & VRING_DESC_F_INDIRECT) == 0) {
+		while (dp->flags & VRING_DESC_F_NEXT) {
+			VQ_RING_ASSERT_VALID_IDX(vq, dp->next);
+			dp = &vq->vq_ring.desc[dp->next];
+			dxp->ndescs--;
+		}
+	}
+
+	VQASSERT(vq, dxp->ndescs == 0,
+		 "failed to free entire desc chain, remaining");
+
+	/*
+	 * We must append the existing free chain, if any, to the end of
+	 * newly freed chain. If the virtqueue was completely used, then
+	 * head would be VQ_RING_DESC_CHAIN_END (ASSERTed above).
+	 *
+	 * CACHE: desc.next is never read by remote, no need to flush it.
+	 */
+	dp->next = vq->vq_desc_head_idx;
+	vq->vq_desc_head_idx = desc_idx;
+}
+
+/*
+ *
+ * virtqueue_ring_update_avail
+ *
+ */
+static inline void virtqueue_ring_update_avail(struct virtqueue *vq,
+					       uint16_t desc_idx)
+{
+	uint16_t avail_idx;
+
+	/*
+	 * Place the head of the descriptor chain into the next slot and make
+	 * it usable to the host. The chain is made available now rather than
+	 * deferring to virtqueue_notify() in the hopes that if the host is
+	 * currently running on another CPU, we can keep it processing the new
+	 * descriptor.
+	 *
+	 * CACHE: avail is never written by remote, so it is safe to not invalidate here
+	 */
+	avail_idx = vq->vq_ring.avail->idx & (vq->vq_nentries - 1);
+	vq->vq_ring.avail->ring[avail_idx] = desc_idx;
+
+	/* We still need to flush the ring */
+	VRING_FLUSH(&vq->vq_ring.avail->ring[avail_idx],
+		    sizeof(vq->vq_ring.avail->ring[avail_idx]));
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	vq->vq_ring.avail->idx++;
+
+	/* And the index */
+	VRING_FLUSH(&vq->vq_ring.avail->idx, sizeof(vq->vq_ring.avail->idx));
+
+	/* Keep pending count until virtqueue_notify(). */
+	vq->vq_queued_cnt++;
+}
+
+/*
+ *
+ * virtqueue_ring_update_used
+ *
+ */
+static inline void virtqueue_ring_update_used(struct virtqueue *vq,
+					      uint16_t head_idx, uint32_t len)
+{
+	struct vring_used_elem *used_desc = NULL;
+	uint16_t used_idx;
+
+	/* CACHE: used is never written by driver, so it's safe to directly access it */
+	used_idx = vq->vq_ring.used->idx & (vq->vq_nentries - 1);
+	used_desc = &vq->vq_ring.used->ring[used_idx];
+	used_desc->id = head_idx;
+	used_desc->len = len;
+
+	/* We still need to flush it because this is read by driver */
+	VRING_FLUSH(&vq->vq_ring.used->ring[used_idx],
+		    sizeof(vq->vq_ring.used->ring[used_idx]));
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	vq->vq_ring.used->idx++;
+
+	/* Used.idx is read by driver, so we need to flush it */
+	VRING_FLUSH(&vq->vq_ring.used->idx, sizeof(vq->vq_ring.used->idx));
+
+	/* Keep pending count until virtqueue_notify(). */
+	vq->vq_queued_cnt++;
+}
+
+/*
+ *
+ * virtqueue_ring_update_used_in_order
+ *
+ */
+static inline void virtqueue_ring_update_used_in_order(struct virtqueue *vq,
+						       uint16_t head_idx,
+						       uint32_t len)
+{
+	struct vq_desc_extra *dxp = &vq->vq_descx[head_idx];
+	uint16_t avail_idx;
+
+	/* Keep the buffer until the ones made available before it are used */
+	dxp->ndescs = 1;
+	dxp->used_len = len;
+
+	/*
+	 * Publish the consumed buffers in the order of the available ring.
+	 * An entry is not rewritten by the driver before its buffer is used.
+	 *
+	 * CACHE: used is never written by driver, so it's safe to directly access it
+	 */
+	while (vq->vq_ring.used->idx != vq->vq_available_idx) {
+		avail_idx = vq->vq_ring.used->idx & (vq->vq_nentries - 1);
+
+		/* Avail.ring is updated by driver, invalidate it */
+		VRING_INVALIDATE(&vq->vq_ring.avail->ring[avail_idx],
+				 sizeof(vq->vq_ring.avail->ring[avail_idx]));
+		head_idx = vq->vq_ring.avail->ring[avail_idx];
+		if (head_idx >= vq->vq_nentries)
+			break;
+
+		dxp = &vq->vq_descx[head_idx];
+		if (!dxp->ndescs)
+			break;
+		dxp->ndescs = 0;
+		virtqueue_ring_update_used(vq, head_idx, dxp->used_len);
+	}
+}
+
+/*
+ *
+ * virtqueue_ring_must_notify
+ *
+ */
+static inline int virtqueue_ring_must_notify(struct virtqueue *vq)
+{
+	uint16_t new_idx, prev_idx, event_idx;
+
+	if (VQ_RING_EVENT_IDX(vq)) {
+		if (VIRTIO_ROLE_IS_DRIVER(vq->vq_dev)) {
+			/* CACHE: no need to invalidate avail */
+			new_idx = vq->vq_ring.avail->idx;
+			prev_idx = new_idx - vq->vq_queued_cnt;
+			VRING_INVALIDATE(&vring_avail_event(&vq->vq_ring),
+					 sizeof(vring_avail_event(&vq->vq_ring)));
+			event_idx = vring_avail_event(&vq->vq_ring);
+			return vring_need_event(event_idx, new_idx,
+						prev_idx) != 0;
+		}
+		if (VIRTIO_ROLE_IS_DEVICE(vq->vq_dev)) {
+			/* CACHE: no need to invalidate used */
+			new_idx = vq->vq_ring.used->idx;
+			prev_idx = new_idx - vq->vq_queued_cnt;
+			VRING_INVALIDATE(&vring_used_event(&vq->vq_ring),
+					 sizeof(vring_used_event(&vq->vq_ring)));
+			event_idx = vring_used_event(&vq->vq_ring);
+			return vring_need_event(event_idx, new_idx,
+						prev_idx) != 0;
+		}
+	} else {
+		if (VIRTIO_ROLE_IS_DRIVER(vq->vq_dev)) {
+			VRING_INVALIDATE(&vq->vq_ring.used->flags,
+					 sizeof(vq->vq_ring.used->flags));
+			return (vq->vq_ring.used->flags &
+				VRING_USED_F_NO_NOTIFY) == 0;
+		}
+		if (VIRTIO_ROLE_IS_DEVICE(vq->vq_dev)) {
+			VRING_INVALIDATE(&vq->vq_ring.avail->flags,
+					 sizeof(vq->vq_ring.avail->flags));
+			return (vq->vq_ring.avail->flags &
+				VRING_AVAIL_F_NO_INTERRUPT) == 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *
+ * virtqueue_ring_notify
+ *
+ */
+static inline void virtqueue_ring_notify(struct virtqueue *vq)
+{
+	if (vq->notify)
+		vq->notify(vq);
+}
+
+/** @brief Inline variant of virtqueue_add_buffer() */
+static inline int virtqueue_add_buffer_inline(struct virtqueue *vq,
+					      struct virtqueue_buf *buf_list,
+					      int readable, int writable,
+					      void *cookie)
+{
+	struct vq_desc_extra *dxp = NULL;
+	int status = VQUEUE_SUCCESS;
+	uint16_t head_idx;
+	uint16_t idx;
+	int needed;
+
+	needed = readable + writable;
+
+	VQ_PARAM_CHK(vq == NULL, status, ERROR_VQUEUE_INVLD_PARAM);
+	VQ_PARAM_CHK(needed < 1, status, ERROR_VQUEUE_INVLD_PARAM);
+	VQ_PARAM_CHK(vq->vq_free_cnt < needed, status, ERROR_VRING_FULL);
+
+	VQUEUE_BUSY(vq);
+
+	if (status == VQUEUE_SUCCESS) {
+		VQASSERT(vq, cookie != NULL, "enqueuing with no cookie");
+
+		head_idx = vq->vq_desc_head_idx;
+		VQ_RING_ASSERT_VALID_IDX(vq, head_idx);
+		dxp = &vq->vq_descx[head_idx];
+
+		VQASSERT(vq, dxp->cookie == NULL,
+			 "cookie already exists for index");
+
+		dxp->cookie = cookie;
+		dxp->ndescs = needed;
+
+		/* Enqueue buffer onto the ring. */
+		idx = virtqueue_ring_add_buffer(vq, vq->vq_ring.desc, head_idx,
+						buf_list, readable, writable);
+
+		vq->vq_desc_head_idx = idx;
+		vq->vq_free_cnt -= needed;
+
+		if (virtqueue_ring_in_order(vq)) {
+			/* Descriptors are recycled as a ring, no chain end */
+		} else if (vq->vq_free_cnt == 0) {
+			VQ_RING_ASSERT_CHAIN_TERM(vq);
+		} else {
+			VQ_RING_ASSERT_VALID_IDX(vq, idx);
+		}
+
+		/*
+		 * Update vring_avail control block fields so that other
+		 * side can get buffer using it.
+		 */
+		virtqueue_ring_update_avail(vq, head_idx);
+	}
+
+	VQUEUE_IDLE(vq);
+
+	return status;
+}
+
+/** @brief Inline variant of virtqueue_get_buffer(), vq must be valid */
+static inline void *virtqueue_get_buffer_inline(struct virtqueue *vq,
+						uint32_t *len, uint16_t *idx)
+{
+	struct vring_used_elem *uep;
+	void *cookie;
+	uint16_t used_idx, desc_idx;
+
+	/* Used.idx is updated by the virtio device, so we need to invalidate */
+	VRING_INVALIDATE(&vq->vq_ring.used->idx, sizeof(vq->vq_ring.used->idx));
+
+	if (vq->vq_used_cons_idx == vq->vq_ring.used->idx)
+		return NULL;
+
+	VQUEUE_BUSY(vq);
+
+	used_idx = vq->vq_used_cons_idx++ & (vq->vq_nentries - 1);
+	uep = &vq->vq_ring.used->ring[used_idx];
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	/* Used.ring is written by remote, invalidate it */
+	VRING_INVALIDATE(&vq->vq_ring.used->ring[used_idx],
+			 sizeof(vq->vq_ring.used->ring[used_idx]));
+
+	if (len)
+		*len = uep->len;
+
+	if (virtqueue_ring_in_order(vq)) {
+		/*
+		 * The buffers are used in the order they were added, so the
+		 * used id is the oldest descriptor chain. It is released in
+		 * ring order, no free chain to walk.
+		 */
+		desc_idx = vq->vq_desc_tail_idx;
+		VQ_RING_ASSERT_VALID_IDX(vq, desc_idx);
+		vq->vq_free_cnt += vq->vq_descx[desc_idx].ndescs;
+		vq->vq_desc_tail_idx = (desc_idx +
+					vq->vq_descx[desc_idx].ndescs) &
+				       (vq->vq_nentries - 1);
+	} else {
+		desc_idx = (uint16_t)uep->id;
+		virtqueue_ring_free_chain(vq, desc_idx);
+	}
+
+	cookie = vq->vq_descx[desc_idx].cookie;
+	vq->vq_descx[desc_idx].cookie = NULL;
+
+	if (idx)
+		*idx = used_idx;
+	VQUEUE_IDLE(vq);
+
+	return cookie;
+}
+
+/** @brief Inline variant of virtqueue_get_buffer_length() */
+static inline uint32_t
+virtqueue_get_buffer_length_inline(struct virtqueue *vq, uint16_t idx)
+{
+	/* Invalidate the desc entry written by driver before accessing it */
+	VRING_INVALIDATE(&vq->vq_ring.desc[idx].len,
+			 sizeof(vq->vq_ring.desc[idx].len));
+	return vq->vq_ring.desc[idx].len;
+}
+
+/** @brief Inline variant of virtqueue_get_buffer_addr() */
+static inline void *virtqueue_get_buffer_addr_inline(struct virtqueue *vq,
+						     uint16_t idx)
+{
+	/* Invalidate the desc entry written by driver before accessing it */
+	VRING_INVALIDATE(&vq->vq_ring.desc[idx].addr,
+			 sizeof(vq->vq_ring.desc[idx].addr));
+	return virtqueue_ring_phys_to_virt(vq, vq->vq_ring.desc[idx].addr);
+}
+
+/** @brief Inline variant of virtqueue_get_first_avail_buffer() */
+static inline void *
+virtqueue_get_first_avail_buffer_inline(struct virtqueue *vq,
+					uint16_t *avail_idx, uint32_t *len)
+{
+	uint16_t head_idx = 0;
+	void *buffer;
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	/* Avail.idx is updated by driver, invalidate it */
+	VRING_INVALIDATE(&vq->vq_ring.avail->idx, sizeof(vq->vq_ring.avail->idx));
+	if (vq->vq_available_idx == vq->vq_ring.avail->idx) {
+		return NULL;
+	}
+
+	VQUEUE_BUSY(vq);
+
+	head_idx = vq->vq_available_idx++ & (vq->vq_nentries - 1);
+
+	/* Avail.ring is updated by driver, invalidate it */
+	VRING_INVALIDATE(&vq->vq_ring.avail->ring[head_idx],
+			 sizeof(vq->vq_ring.avail->ring[head_idx]));
+	*avail_idx = vq->vq_ring.avail->ring[head_idx];
+
+	buffer = virtqueue_get_buffer_addr_inline(vq, *avail_idx);
+	*len = virtqueue_get_buffer_length_inline(vq, *avail_idx);
+
+	VQUEUE_IDLE(vq);
+
+	return buffer;
+}
+
+/** @brief Inline variant of virtqueue_add_consumed_buffer() */
+static inline int
+virtqueue_add_consumed_buffer_inline(struct virtqueue *vq, uint16_t head_idx,
+				     uint32_t len)
+{
+	if (head_idx >= vq->vq_nentries) {
+		return ERROR_VRING_NO_BUFF;
+	}
+
+	VQUEUE_BUSY(vq);
+
+	if (virtqueue_ring_in_order(vq))
+		virtqueue_ring_update_used_in_order(vq, head_idx, len);
+	else
+		virtqueue_ring_update_used(vq, head_idx, len);
+
+	VQUEUE_IDLE(vq);
+
+	return VQUEUE_SUCCESS;
+}
+
+/** @brief Inline variant of virtqueue_kick() */
+static inline void virtqueue_kick_inline(struct virtqueue *vq)
+{
+	VQUEUE_BUSY(vq);
+
+	/* Ensure updated avail->idx is visible to host. */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (virtqueue_ring_must_notify(vq))
+		virtqueue_ring_notify(vq);
+
+	vq->vq_queued_cnt = 0;
+
+	VQUEUE_IDLE(vq);
+}
+
+#if defined __cplusplus
+}
+#endif
+
+#endif /* VIRTQUEUE_INLINE_H_ */
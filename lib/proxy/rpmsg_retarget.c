@@ -6,7 +6,9 @@
  */
 
 #include <errno.h>
+#include <metal/condition.h>
 #include <metal/mutex.h>
+#include <metal/sleep.h>
 #include <metal/spinlock.h>
 #include <metal/utilities.h>
 #include <openamp/open_amp.h>
@@ -15,24 +17,204 @@
 #include <string.h>
 #include <fcntl.h>
 
+#include "rpmsg_retarget_internal.h"
+
 /*************************************************************************
  *	Description
  *	This files contains rpmsg based redefinitions for C RTL system calls
  *	such as _open, _read, _write, _close.
  *************************************************************************/
 static struct rpmsg_rpc_data *rpmsg_default_rpc;
+static rpmsg_rpc_select rpmsg_rpc_selector;
+
+/* Caller of rpmsg_rpc_send() waiting for the answer of a tagged request */
+struct rpmsg_rpc_waiter {
+	uint32_t tag;
+	void *respbuf;
+	size_t respbuf_len;
+	int done;
+	struct rpmsg_rpc_waiter *next;
+};
+
+/* Condition of rpmsg_rpc_wait(), called with buflock held */
+typedef int (*rpmsg_rpc_wait_done)(struct rpmsg_rpc_data *rpc, void *arg);
+
+static int rpmsg_rpc_wait_check(struct rpmsg_rpc_data *rpc,
+				rpmsg_rpc_wait_done done, void *arg)
+{
+	int ret;
+
+	metal_spinlock_acquire(&rpc->buflock);
+	ret = rpc->ept_destroyed || done(rpc, arg);
+	metal_spinlock_release(&rpc->buflock);
+
+	return ret;
+}
+
+/* Wait for an answer of the remote with the wait strategy of the RPC */
+static void rpmsg_rpc_wait(struct rpmsg_rpc_data *rpc,
+			   rpmsg_rpc_wait_done done, void *arg)
+{
+	unsigned int spin = rpc->wait_spin;
+
+	if (rpc->wait_mode == RPMSG_RPC_WAIT_BLOCK)
+		spin = 0;
+	while (rpc->wait_mode == RPMSG_RPC_WAIT_SPIN || spin--) {
+		if (rpmsg_rpc_wait_check(rpc, done, arg))
+			return;
+		if (rpc->poll)
+			rpc->poll(rpc->poll_arg);
+	}
+
+	/*
+	 * The blocked count is raised under buflock before checking, so the
+	 * endpoint callback either sees it or is seen by the check, and it
+	 * signals under the lock, so no wakeup is lost.
+	 */
+	metal_mutex_acquire(&rpc->wait_lock);
+	metal_spinlock_acquire(&rpc->buflock);
+	rpc->wait_blocked++;
+	metal_spinlock_release(&rpc->buflock);
+	while (!rpmsg_rpc_wait_check(rpc, done, arg))
+		metal_condition_wait(&rpc->wait_cond, &rpc->wait_lock);
+	metal_spinlock_acquire(&rpc->buflock);
+	rpc->wait_blocked--;
+	metal_spinlock_release(&rpc->buflock);
+	metal_mutex_release(&rpc->wait_lock);
+}
+
+/* Wake the blocked callers, if any, after an update under buflock */
+static void rpmsg_rpc_wake(struct rpmsg_rpc_data *rpc)
+{
+	unsigned int blocked;
+
+	metal_spinlock_acquire(&rpc->buflock);
+	blocked = rpc->wait_blocked;
+	metal_spinlock_release(&rpc->buflock);
+	if (!blocked)
+		return;
+	metal_mutex_acquire(&rpc->wait_lock);
+	metal_condition_broadcast(&rpc->wait_cond);
+	metal_mutex_release(&rpc->wait_lock);
+}
+
+struct rpmsg_rpc_data *rpmsg_rpc_get(int fd)
+{
+	struct rpmsg_rpc_data *rpc = NULL;
+
+	if (rpmsg_rpc_selector)
+		rpc = rpmsg_rpc_selector(fd);
+
+	return rpc ? rpc : rpmsg_default_rpc;
+}
+
+static void rpmsg_rpc_waiter_del(struct rpmsg_rpc_data *rpc,
+				 struct rpmsg_rpc_waiter *waiter)
+{
+	struct rpmsg_rpc_waiter **prev;
+
+	for (prev = &rpc->waiters; *prev; prev = &(*prev)->next) {
+		if (*prev == waiter) {
+			*prev = waiter->next;
+			break;
+		}
+	}
+}
+
+/* Deliver the answer of a tagged request, called with buflock held */
+static void rpmsg_rpc_answer(struct rpmsg_rpc_data *rpc, uint32_t tag,
+			     void *data, size_t len)
+{
+	struct rpmsg_rpc_waiter *waiter;
+
+	for (waiter = rpc->waiters; waiter; waiter = waiter->next)
+		if (waiter->tag == tag)
+			break;
+	if (!waiter)
+		return;
+
+	if (len > waiter->respbuf_len)
+		len = waiter->respbuf_len;
+	memcpy(waiter->respbuf, data, len);
+	/* Callers check the syscall ID of the answer without its tag */
+	if (len >= sizeof(uint32_t))
+		*(uint32_t *)waiter->respbuf &= RPMSG_RPC_ID_MASK;
+	waiter->done = 1;
+	rpmsg_rpc_waiter_del(rpc, waiter);
+}
+
+/* Account the ack of an asynchronous write, called with buflock held */
+static void rpmsg_rpc_write_ack(struct rpmsg_rpc_data *rpc,
+				struct rpmsg_rpc_syscall *resp, size_t len)
+{
+	int32_t n = len < sizeof(*resp) ? -EINVAL : resp->args.int_field1;
+
+	rpc->wpending--;
+	if (n < 0 && !rpc->werr)
+		rpc->werr = n;
+	if (n > 0)
+		rpc->wbytes -= metal_min((uint32_t)n, rpc->wbytes);
+	/*
+	 * The acks only carry the written length, a short write shows once
+	 * all the pending writes are acked with bytes left over
+	 */
+	if (!rpc->wpending) {
+		if (rpc->wbytes && !rpc->werr)
+			rpc->werr = -EIO;
+		rpc->wbytes = 0;
+	}
+}
+
+/* Store the answer of a read-ahead request, called with buflock held */
+static void rpmsg_rpc_read_fill(struct rpmsg_rpc_read_cache *cache,
+				struct rpmsg_rpc_syscall *resp, size_t len)
+{
+	unsigned char *data = (unsigned char *)(resp + 1);
+	uint32_t n, tail, part;
+
+	cache->inflight--;
+	if (len < sizeof(*resp) || resp->args.int_field1 < 0) {
+		if (!cache->err)
+			cache->err = len < sizeof(*resp) ?
+				     -EINVAL : resp->args.int_field1;
+		return;
+	}
+	if (resp->args.int_field1 == 0) {
+		cache->eof = 1;
+		return;
+	}
+
+	/* Room for a chunk was reserved when the request was sent */
+	n = resp->args.int_field1;
+	if (n > resp->args.data_len)
+		n = resp->args.data_len;
+	if (n > len - sizeof(*resp))
+		n = len - sizeof(*resp);
+	if (n > cache->chunk)
+		n = cache->chunk;
+	tail = (cache->head + cache->len) % cache->size;
+	part = cache->size - tail;
+	if (part > n)
+		part = n;
+	memcpy(cache->buf + tail, data, part);
+	memcpy(cache->buf, data + part, n - part);
+	cache->len += n;
+}
 
 static int rpmsg_rpc_ept_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
 			    uint32_t src, void *priv)
 {
 	struct rpmsg_rpc_syscall *syscall;
+	uint32_t id, tag;
 
 	(void)priv;
 	(void)src;
 
 	if (data && ept) {
 		syscall = data;
-		if (syscall->id == TERM_SYSCALL_ID) {
+		id = syscall->id & RPMSG_RPC_ID_MASK;
+		tag = syscall->id >> RPMSG_RPC_TAG_SHIFT;
+		if (id == TERM_SYSCALL_ID) {
 			rpmsg_destroy_ept(ept);
 		} else {
 			struct rpmsg_rpc_data *rpc;
@@ -41,13 +223,29 @@ static int rpmsg_rpc_ept_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
 						 struct rpmsg_rpc_data,
 						 ept);
 			metal_spinlock_acquire(&rpc->buflock);
-			if (rpc->respbuf && rpc->respbuf_len != 0) {
-				if (len > rpc->respbuf_len)
-					len = rpc->respbuf_len;
-				memcpy(rpc->respbuf, data, len);
+			if (tag) {
+				rpmsg_rpc_answer(rpc, tag, data, len);
+			} else if (id == WRITE_SYSCALL_ID && rpc->wpending) {
+				/*
+				 * The remote answers in order, the write acks
+				 * received while asynchronous writes are
+				 * pending are theirs.
+				 */
+				rpmsg_rpc_write_ack(rpc, syscall, len);
+			} else if (id == READ_SYSCALL_ID && rpc->rpending) {
+				/* Same for the read-ahead requests */
+				rpc->rpending--;
+				rpmsg_rpc_read_fill(rpc->rcache, syscall, len);
+			} else {
+				if (rpc->respbuf && rpc->respbuf_len != 0) {
+					if (len > rpc->respbuf_len)
+						len = rpc->respbuf_len;
+					memcpy(rpc->respbuf, data, len);
+				}
+				atomic_flag_clear(&rpc->nacked);
 			}
-			atomic_flag_clear(&rpc->nacked);
 			metal_spinlock_release(&rpc->buflock);
+			rpmsg_rpc_wake(rpc);
 		}
 	}
 
@@ -62,21 +260,60 @@ static void rpmsg_service_unbind(struct rpmsg_endpoint *ept)
 	rpc->ept_destroyed = 1;
 	rpmsg_destroy_ept(ept);
 	atomic_flag_clear(&rpc->nacked);
+	rpmsg_rpc_wake(rpc);
 	if (rpc->shutdown_cb)
 		rpc->shutdown_cb(rpc);
 }
 
+static int rpmsg_rpc_ept_ready(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	(void)arg;
+
+	return is_rpmsg_ept_ready(&rpc->ept);
+}
+
+/*
+ * Wait for the endpoint to be bound to the remote. The name service
+ * announcement binding it does not call the endpoint callback, so the
+ * blocking strategies cannot wait on the condition and sleep between
+ * checks instead.
+ */
+static void rpmsg_rpc_wait_ready(struct rpmsg_rpc_data *rpc)
+{
+	if (rpc->wait_mode == RPMSG_RPC_WAIT_SPIN) {
+		rpmsg_rpc_wait(rpc, rpmsg_rpc_ept_ready, NULL);
+		return;
+	}
+	while (!rpmsg_rpc_wait_check(rpc, rpmsg_rpc_ept_ready, NULL))
+		metal_sleep_usec(RPMSG_RPC_READY_SLEEP_US);
+}
+
 int rpmsg_rpc_init(struct rpmsg_rpc_data *rpc,
 		   struct rpmsg_device *rdev,
 		   const char *ept_name, uint32_t ept_addr,
 		   uint32_t ept_raddr,
 		   void *poll_arg, rpmsg_rpc_poll poll,
 		   rpmsg_rpc_shutdown_cb shutdown_cb)
+{
+	return rpmsg_rpc_init_with_wait(rpc, rdev, ept_name, ept_addr,
+					ept_raddr, poll_arg, poll, shutdown_cb,
+					RPMSG_RPC_WAIT_SPIN, 0);
+}
+
+int rpmsg_rpc_init_with_wait(struct rpmsg_rpc_data *rpc,
+			     struct rpmsg_device *rdev,
+			     const char *ept_name, uint32_t ept_addr,
+			     uint32_t ept_raddr,
+			     void *poll_arg, rpmsg_rpc_poll poll,
+			     rpmsg_rpc_shutdown_cb shutdown_cb,
+			     int wait_mode, unsigned int wait_spin)
 {
 	int ret;
 
 	if (!rpc || !rdev)
 		return -EINVAL;
+	if (wait_mode < RPMSG_RPC_WAIT_SPIN || wait_mode > RPMSG_RPC_WAIT_BLOCK)
+		return -EINVAL;
 	metal_spinlock_init(&rpc->buflock);
 	metal_mutex_init(&rpc->lock);
 	rpc->shutdown_cb = shutdown_cb;
@@ -85,6 +322,23 @@ int rpmsg_rpc_init(struct rpmsg_rpc_data *rpc,
 	rpc->ept_destroyed = 0;
 	rpc->respbuf = NULL;
 	rpc->respbuf_len = 0;
+	rpc->write_mode = RPMSG_RPC_WRITE_SYNC;
+	rpc->wbuf = NULL;
+	rpc->wlen = 0;
+	rpc->wpending = 0;
+	rpc->wbytes = 0;
+	rpc->werr = 0;
+	rpc->rcaches = NULL;
+	rpc->rcache = NULL;
+	rpc->rpending = 0;
+	rpc->tagged = 0;
+	rpc->next_tag = 0;
+	rpc->waiters = NULL;
+	rpc->wait_mode = wait_mode;
+	rpc->wait_spin = wait_spin;
+	rpc->wait_blocked = 0;
+	metal_mutex_init(&rpc->wait_lock);
+	metal_condition_init(&rpc->wait_cond);
 	rpc->nacked = (atomic_flag)ATOMIC_FLAG_INIT;
 	atomic_flag_test_and_set(&rpc->nacked);
 	ret = rpmsg_create_ept(&rpc->ept, rdev,
@@ -94,10 +348,18 @@ int rpmsg_rpc_init(struct rpmsg_rpc_data *rpc,
 		metal_mutex_release(&rpc->lock);
 		return -EINVAL;
 	}
-	while (!is_rpmsg_ept_ready(&rpc->ept)) {
-		if (rpc->poll)
-			rpc->poll(rpc->poll_arg);
-	}
+	rpmsg_rpc_wait_ready(rpc);
+	return 0;
+}
+
+int rpmsg_rpc_set_wait(struct rpmsg_rpc_data *rpc, int mode,
+		       unsigned int spin)
+{
+	if (!rpc || mode < RPMSG_RPC_WAIT_SPIN || mode > RPMSG_RPC_WAIT_BLOCK)
+		return -EINVAL;
+	rpc->wait_spin = spin;
+	rpc->wait_mode = mode;
+
 	return 0;
 }
 
@@ -105,8 +367,13 @@ void rpmsg_rpc_release(struct rpmsg_rpc_data *rpc)
 {
 	if (!rpc)
 		return;
-	if (rpc->ept_destroyed == 0)
+	if (rpc->ept_destroyed == 0) {
+		/* Do not lose the buffered output */
+		rpmsg_rpc_flush(rpc);
 		rpmsg_destroy_ept(&rpc->ept);
+	}
+	rpc->wbuf = NULL;
+	rpc->rcaches = NULL;
 	metal_mutex_acquire(&rpc->lock);
 	metal_spinlock_acquire(&rpc->buflock);
 	rpc->respbuf = NULL;
@@ -114,6 +381,308 @@ void rpmsg_rpc_release(struct rpmsg_rpc_data *rpc)
 	metal_spinlock_release(&rpc->buflock);
 	metal_mutex_release(&rpc->lock);
 	metal_mutex_deinit(&rpc->lock);
+	/* wait_cond has no deinit in libmetal, releasing its lock is enough */
+	metal_mutex_deinit(&rpc->wait_lock);
+}
+
+/* Take the first error of the asynchronous writes */
+static int rpmsg_rpc_write_error(struct rpmsg_rpc_data *rpc)
+{
+	int ret;
+
+	metal_spinlock_acquire(&rpc->buflock);
+	ret = rpc->werr;
+	rpc->werr = 0;
+	metal_spinlock_release(&rpc->buflock);
+
+	return ret;
+}
+
+/* Send the coalesced writes, must be called with the RPC lock held */
+static int rpmsg_rpc_write_push(struct rpmsg_rpc_data *rpc)
+{
+	struct rpmsg_rpc_syscall *syscall = rpc->wbuf;
+	int null_term = rpc->wfd == 1;
+	int ret;
+
+	if (!syscall)
+		return 0;
+
+	syscall->id = WRITE_SYSCALL_ID;
+	syscall->args.int_field1 = rpc->wfd;
+	syscall->args.int_field2 = rpc->wlen;
+	syscall->args.data_len = rpc->wlen + null_term;
+	if (null_term)
+		*((char *)(syscall + 1) + rpc->wlen) = 0;
+
+	/* Count the write before its ack can be received */
+	metal_spinlock_acquire(&rpc->buflock);
+	rpc->wpending++;
+	rpc->wbytes += rpc->wlen;
+	metal_spinlock_release(&rpc->buflock);
+	ret = rpmsg_send_nocopy(&rpc->ept, syscall,
+				sizeof(*syscall) + rpc->wlen + null_term);
+	if (ret < 0) {
+		rpmsg_release_tx_buffer(&rpc->ept, syscall);
+		metal_spinlock_acquire(&rpc->buflock);
+		rpc->wpending--;
+		rpc->wbytes -= rpc->wlen;
+		if (!rpc->werr)
+			rpc->werr = -EINVAL;
+		metal_spinlock_release(&rpc->buflock);
+	}
+	rpc->wbuf = NULL;
+	rpc->wlen = 0;
+
+	return ret < 0 ? -EINVAL : 0;
+}
+
+int rpmsg_rpc_set_write_mode(struct rpmsg_rpc_data *rpc, int mode)
+{
+	int ret;
+
+	if (!rpc || mode < RPMSG_RPC_WRITE_SYNC ||
+	    mode > RPMSG_RPC_WRITE_COALESCE)
+		return -EINVAL;
+
+	ret = rpmsg_rpc_flush(rpc);
+	rpc->write_mode = mode;
+
+	return ret;
+}
+
+static int rpmsg_rpc_write_done(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	(void)arg;
+
+	return !rpc->wpending;
+}
+
+int rpmsg_rpc_flush(struct rpmsg_rpc_data *rpc)
+{
+	if (!rpc)
+		return -EINVAL;
+
+	metal_mutex_acquire(&rpc->lock);
+	rpmsg_rpc_write_push(rpc);
+	metal_mutex_release(&rpc->lock);
+	rpmsg_rpc_wait(rpc, rpmsg_rpc_write_done, NULL);
+
+	return rpmsg_rpc_write_error(rpc);
+}
+
+static int rpmsg_rpc_read_done(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	(void)arg;
+
+	return !rpc->rpending;
+}
+
+/* Wait for the answers of the read-ahead requests, called with the lock held */
+static void rpmsg_rpc_read_drain(struct rpmsg_rpc_data *rpc)
+{
+	rpmsg_rpc_wait(rpc, rpmsg_rpc_read_done, NULL);
+}
+
+/* Send read requests to fill the cache, called with the lock held */
+static void rpmsg_rpc_read_ahead(struct rpmsg_rpc_data *rpc,
+				 struct rpmsg_rpc_read_cache *cache)
+{
+	struct rpmsg_rpc_syscall syscall;
+	int ret;
+
+	/* The read-ahead answers are stored in a single cache at a time */
+	if (rpc->rcache != cache) {
+		rpmsg_rpc_read_drain(rpc);
+		rpc->rcache = cache;
+	}
+	rpmsg_rpc_write_push(rpc);
+
+	syscall.id = READ_SYSCALL_ID;
+	syscall.args.int_field1 = cache->fd;
+	syscall.args.int_field2 = cache->chunk;
+	syscall.args.data_len = 0;	/*not used */
+
+	metal_spinlock_acquire(&rpc->buflock);
+	while (!cache->eof && !cache->err && !rpc->ept_destroyed &&
+	       cache->size - cache->len >=
+	       (cache->inflight + 1) * cache->chunk) {
+		cache->inflight++;
+		rpc->rpending++;
+		metal_spinlock_release(&rpc->buflock);
+		ret = rpmsg_send(&rpc->ept, &syscall, sizeof(syscall));
+		metal_spinlock_acquire(&rpc->buflock);
+		if (ret < 0) {
+			cache->inflight--;
+			rpc->rpending--;
+			cache->err = -EINVAL;
+		}
+	}
+	metal_spinlock_release(&rpc->buflock);
+}
+
+static struct rpmsg_rpc_read_cache *
+rpmsg_rpc_read_cache_find(struct rpmsg_rpc_data *rpc, int fd)
+{
+	struct rpmsg_rpc_read_cache *cache;
+
+	for (cache = rpc->rcaches; cache; cache = cache->next)
+		if (cache->fd == fd)
+			break;
+
+	return cache;
+}
+
+uint32_t rpmsg_rpc_read_cache_drop(struct rpmsg_rpc_data *rpc, int fd)
+{
+	struct rpmsg_rpc_read_cache *cache;
+	uint32_t len = 0;
+
+	metal_mutex_acquire(&rpc->lock);
+	cache = rpmsg_rpc_read_cache_find(rpc, fd);
+	if (cache) {
+		if (rpc->rcache == cache)
+			rpmsg_rpc_read_drain(rpc);
+		metal_spinlock_acquire(&rpc->buflock);
+		len = cache->len;
+		cache->head = 0;
+		cache->len = 0;
+		cache->err = 0;
+		cache->eof = 0;
+		metal_spinlock_release(&rpc->buflock);
+	}
+	metal_mutex_release(&rpc->lock);
+
+	return len;
+}
+
+int rpmsg_rpc_read_cache_init(struct rpmsg_rpc_data *rpc,
+			      struct rpmsg_rpc_read_cache *cache,
+			      int fd, void *buf, uint32_t size)
+{
+	int chunk;
+	int ret = 0;
+
+	if (!rpc || !cache || !buf)
+		return -EINVAL;
+	chunk = rpmsg_get_rx_buffer_size(&rpc->ept);
+	if (chunk <= (int)sizeof(struct rpmsg_rpc_syscall))
+		return -EINVAL;
+	chunk -= sizeof(struct rpmsg_rpc_syscall);
+	if (size < (uint32_t)chunk)
+		return -EINVAL;
+
+	cache->fd = fd;
+	cache->buf = buf;
+	cache->size = size;
+	cache->chunk = chunk;
+	cache->head = 0;
+	cache->len = 0;
+	cache->inflight = 0;
+	cache->err = 0;
+	cache->eof = 0;
+
+	metal_mutex_acquire(&rpc->lock);
+	if (rpmsg_rpc_read_cache_find(rpc, fd)) {
+		ret = -EINVAL;
+	} else {
+		cache->next = rpc->rcaches;
+		rpc->rcaches = cache;
+	}
+	metal_mutex_release(&rpc->lock);
+
+	return ret;
+}
+
+void rpmsg_rpc_read_cache_release(struct rpmsg_rpc_data *rpc,
+				  struct rpmsg_rpc_read_cache *cache)
+{
+	struct rpmsg_rpc_read_cache **prev;
+
+	if (!rpc || !cache)
+		return;
+
+	metal_mutex_acquire(&rpc->lock);
+	if (rpc->rcache == cache) {
+		rpmsg_rpc_read_drain(rpc);
+		rpc->rcache = NULL;
+	}
+	for (prev = &rpc->rcaches; *prev; prev = &(*prev)->next) {
+		if (*prev == cache) {
+			*prev = cache->next;
+			break;
+		}
+	}
+	metal_mutex_release(&rpc->lock);
+}
+
+void rpmsg_rpc_set_tagging(struct rpmsg_rpc_data *rpc, int enable)
+{
+	if (!rpc)
+		return;
+	metal_mutex_acquire(&rpc->lock);
+	rpc->tagged = enable;
+	metal_mutex_release(&rpc->lock);
+}
+
+static int rpmsg_rpc_tag_done(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	struct rpmsg_rpc_waiter *waiter = arg;
+
+	(void)rpc;
+
+	return waiter->done;
+}
+
+static int rpmsg_rpc_send_tagged(struct rpmsg_rpc_data *rpc,
+				 void *req, size_t len,
+				 void *resp, size_t resp_len)
+{
+	struct rpmsg_rpc_syscall *syscall = req;
+	struct rpmsg_rpc_waiter waiter;
+	uint32_t id;
+	int ret;
+
+	if (len < sizeof(*syscall))
+		return -EINVAL;
+	waiter.respbuf = resp;
+	waiter.respbuf_len = resp_len;
+	waiter.done = 0;
+
+	metal_mutex_acquire(&rpc->lock);
+	/* Keep the order of the coalesced writes and of this request */
+	rpmsg_rpc_write_push(rpc);
+	metal_spinlock_acquire(&rpc->buflock);
+	rpc->next_tag = rpc->next_tag % RPMSG_RPC_ID_MASK + 1;
+	waiter.tag = rpc->next_tag;
+	waiter.next = rpc->waiters;
+	rpc->waiters = &waiter;
+	metal_spinlock_release(&rpc->buflock);
+	id = syscall->id;
+	syscall->id = (id & RPMSG_RPC_ID_MASK) |
+		      (waiter.tag << RPMSG_RPC_TAG_SHIFT);
+	ret = rpmsg_send(&rpc->ept, req, len);
+	syscall->id = id;
+	metal_mutex_release(&rpc->lock);
+
+	if (ret >= 0)
+		rpmsg_rpc_wait(rpc, rpmsg_rpc_tag_done, &waiter);
+
+	metal_spinlock_acquire(&rpc->buflock);
+	if (!waiter.done) {
+		rpmsg_rpc_waiter_del(rpc, &waiter);
+		ret = -EINVAL;
+	}
+	metal_spinlock_release(&rpc->buflock);
+
+	return ret < 0 ? -EINVAL : ret;
+}
+
+static int rpmsg_rpc_acked(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	(void)arg;
+
+	return !atomic_flag_test_and_set(&rpc->nacked);
 }
 
 int rpmsg_rpc_send(struct rpmsg_rpc_data *rpc,
@@ -124,20 +693,30 @@ int rpmsg_rpc_send(struct rpmsg_rpc_data *rpc,
 
 	if (!rpc)
 		return -EINVAL;
+	if (rpc->tagged && resp)
+		return rpmsg_rpc_send_tagged(rpc, req, len, resp, resp_len);
+
+	/*
+	 * Untagged answers are matched by order, exchange one request at a
+	 * time so that the response buffer is not overwritten
+	 */
+	metal_mutex_acquire(&rpc->lock);
+	/* Keep the order of the coalesced writes and of this request */
+	rpmsg_rpc_write_push(rpc);
+
 	metal_spinlock_acquire(&rpc->buflock);
 	rpc->respbuf = resp;
 	rpc->respbuf_len = resp_len;
 	metal_spinlock_release(&rpc->buflock);
 	(void)atomic_flag_test_and_set(&rpc->nacked);
 	ret = rpmsg_send(&rpc->ept, req, len);
-	if (ret < 0)
-		return -EINVAL;
-	if (!resp)
-		return ret;
-	while ((atomic_flag_test_and_set(&rpc->nacked))) {
-		if (rpc->poll)
-			rpc->poll(rpc->poll_arg);
+	if (ret < 0) {
+		ret = -EINVAL;
+	} else if (resp) {
+		rpmsg_rpc_wait(rpc, rpmsg_rpc_acked, NULL);
 	}
+	metal_mutex_release(&rpc->lock);
+
 	return ret;
 }
 
@@ -148,6 +727,11 @@ void rpmsg_set_default_rpc(struct rpmsg_rpc_data *rpc)
 	rpmsg_default_rpc = rpc;
 }
 
+void rpmsg_set_rpc_select(rpmsg_rpc_select select)
+{
+	rpmsg_rpc_selector = select;
+}
+
 /*************************************************************************
  *
  *   FUNCTION
@@ -163,7 +747,7 @@ void rpmsg_set_default_rpc(struct rpmsg_rpc_data *rpc)
 
 int _open(const char *filename, int flags, int mode)
 {
-	struct rpmsg_rpc_data *rpc = rpmsg_default_rpc;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(-1);
 	struct rpmsg_rpc_syscall *syscall;
 	struct rpmsg_rpc_syscall resp;
 	int filename_len = strlen(filename) + 1;
@@ -211,11 +795,68 @@ int _open(const char *filename, int flags, int mode)
  *       Low level function to redirect IO to serial.
  *
  *************************************************************************/
+static int rpmsg_rpc_read_ready(struct rpmsg_rpc_data *rpc, void *arg)
+{
+	struct rpmsg_rpc_read_cache *cache = arg;
+
+	(void)rpc;
+
+	return cache->len || !cache->inflight;
+}
+
+static int rpmsg_rpc_read_cached(struct rpmsg_rpc_data *rpc,
+				 struct rpmsg_rpc_read_cache *cache,
+				 char *buffer, int buflen)
+{
+	uint32_t n, part;
+	int ret;
+
+	metal_mutex_acquire(&rpc->lock);
+	rpmsg_rpc_read_ahead(rpc, cache);
+	rpmsg_rpc_wait(rpc, rpmsg_rpc_read_ready, cache);
+	metal_spinlock_acquire(&rpc->buflock);
+	n = cache->len;
+	if (!n) {
+		/* Report the error or the end of file once */
+		if (cache->err)
+			ret = cache->err;
+		else
+			ret = cache->eof ? 0 : -EINVAL;
+		cache->err = 0;
+		cache->eof = 0;
+		metal_spinlock_release(&rpc->buflock);
+		metal_mutex_release(&rpc->lock);
+		return ret;
+	}
+	metal_spinlock_release(&rpc->buflock);
+
+	/* The answers only fill the ring after the data */
+	if (n > (uint32_t)buflen)
+		n = buflen;
+	part = cache->size - cache->head;
+	if (part > n)
+		part = n;
+	memcpy(buffer, cache->buf + cache->head, part);
+	memcpy(buffer + part, cache->buf, n - part);
+
+	metal_spinlock_acquire(&rpc->buflock);
+	cache->head = (cache->head + n) % cache->size;
+	cache->len -= n;
+	metal_spinlock_release(&rpc->buflock);
+
+	/* Keep the requests in flight while the data is consumed */
+	rpmsg_rpc_read_ahead(rpc, cache);
+	metal_mutex_release(&rpc->lock);
+
+	return n;
+}
+
 int _read(int fd, char *buffer, int buflen)
 {
+	struct rpmsg_rpc_read_cache *cache;
 	struct rpmsg_rpc_syscall syscall;
 	struct rpmsg_rpc_syscall *resp;
-	struct rpmsg_rpc_data *rpc = rpmsg_default_rpc;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
 	int payload_size = sizeof(syscall);
 	unsigned char tmpbuf[MAX_BUF_LEN];
 	int ret;
@@ -223,6 +864,12 @@ int _read(int fd, char *buffer, int buflen)
 	if (!rpc || !buffer || buflen == 0)
 		return -EINVAL;
 
+	metal_mutex_acquire(&rpc->lock);
+	cache = rpmsg_rpc_read_cache_find(rpc, fd);
+	metal_mutex_release(&rpc->lock);
+	if (cache)
+		return rpmsg_rpc_read_cached(rpc, cache, buffer, buflen);
+
 	/* Construct rpc payload */
 	syscall.id = READ_SYSCALL_ID;
 	syscall.args.int_field1 = fd;
@@ -255,6 +902,60 @@ int _read(int fd, char *buffer, int buflen)
 	return ret;
 }
 
+static int rpmsg_rpc_write_async(struct rpmsg_rpc_data *rpc, int fd,
+				 const char *ptr, int len)
+{
+	struct rpmsg_rpc_syscall *syscall;
+	uint32_t room;
+	int ret = 0, done = 0;
+
+	/* Report the error of a previous write */
+	ret = rpmsg_rpc_write_error(rpc);
+	if (ret)
+		return ret;
+
+	metal_mutex_acquire(&rpc->lock);
+	if (rpc->wbuf && rpc->wfd != fd)
+		ret = rpmsg_rpc_write_push(rpc);
+	while (!ret && done < len) {
+		if (!rpc->wbuf) {
+			rpc->wbuf = rpmsg_get_tx_payload_buffer(&rpc->ept,
+								&rpc->wbuf_len,
+								1);
+			if (!rpc->wbuf) {
+				ret = -ENOMEM;
+				break;
+			}
+			if (rpc->wbuf_len <= sizeof(*syscall) + 1) {
+				rpmsg_release_tx_buffer(&rpc->ept, rpc->wbuf);
+				rpc->wbuf = NULL;
+				ret = -EINVAL;
+				break;
+			}
+			rpc->wfd = fd;
+			rpc->wlen = 0;
+		}
+
+		/* Fill the TX buffer, keeping room for the null terminator */
+		syscall = rpc->wbuf;
+		room = rpc->wbuf_len - sizeof(*syscall) - 1 - rpc->wlen;
+		if (room > (uint32_t)(len - done))
+			room = len - done;
+		memcpy((char *)(syscall + 1) + rpc->wlen, ptr + done, room);
+		rpc->wlen += room;
+		done += room;
+
+		if (rpc->write_mode == RPMSG_RPC_WRITE_ASYNC ||
+		    rpc->wlen == rpc->wbuf_len - sizeof(*syscall) - 1)
+			ret = rpmsg_rpc_write_push(rpc);
+	}
+	metal_mutex_release(&rpc->lock);
+
+	if (!done)
+		return ret ? ret : rpmsg_rpc_write_error(rpc);
+	return done;
+}
+
 /*************************************************************************
  *
  *   FUNCTION
@@ -271,41 +972,50 @@ int _write(int fd, const char *ptr, int len)
 	int ret;
 	struct rpmsg_rpc_syscall *syscall;
 	struct rpmsg_rpc_syscall resp;
-	int payload_size = sizeof(*syscall) + len;
-	struct rpmsg_rpc_data *rpc = rpmsg_default_rpc;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
 	unsigned char tmpbuf[MAX_BUF_LEN];
 	unsigned char *tmpptr;
 	int null_term = 0;
+	int chunk, done = 0;
 
 	if (!rpc)
 		return -EINVAL;
+	if (rpc->write_mode != RPMSG_RPC_WRITE_SYNC)
+		return rpmsg_rpc_write_async(rpc, fd, ptr, len);
 	if (fd == 1)
 		null_term = 1;
 
 	syscall = (void *)tmpbuf;
-	syscall->id = WRITE_SYSCALL_ID;
-	syscall->args.int_field1 = fd;
-	syscall->args.int_field2 = len;
-	syscall->args.data_len = len + null_term;
 	tmpptr = tmpbuf + sizeof(*syscall);
-	memcpy(tmpptr, ptr, len);
-	if (null_term == 1) {
-		*(char *)(tmpptr + len + null_term) = 0;
-		payload_size += 1;
-	}
-	resp.id = 0;
-	ret = rpmsg_rpc_send(rpc, tmpbuf, payload_size,
-			     (void *)&resp, sizeof(resp));
+	/* Send the data in chunks fitting in the request buffer */
+	do {
+		chunk = len - done;
+		if (chunk > (int)(MAX_BUF_LEN - sizeof(*syscall) - null_term))
+			chunk = MAX_BUF_LEN - sizeof(*syscall) - null_term;
+		syscall->id = WRITE_SYSCALL_ID;
+		syscall->args.int_field1 = fd;
+		syscall->args.int_field2 = chunk;
+		syscall->args.data_len = chunk + null_term;
+		memcpy(tmpptr, ptr + done, chunk);
+		if (null_term == 1)
+			*(char *)(tmpptr + chunk) = 0;
+		resp.id = 0;
+		ret = rpmsg_rpc_send(rpc, tmpbuf,
+				     sizeof(*syscall) + chunk + null_term,
+				     (void *)&resp, sizeof(resp));
 
-	if (ret >= 0) {
-		if (resp.id == WRITE_SYSCALL_ID)
-			ret = resp.args.int_field1;
-		else
-			ret = -EINVAL;
-	}
-
-	return ret;
+		if (ret >= 0) {
+			if (resp.id == WRITE_SYSCALL_ID)
+				ret = resp.args.int_field1;
+			else
+				ret = -EINVAL;
+		}
+		if (ret < 0)
+			return done ? done : ret;
+		done += ret;
+	} while (ret == chunk && done < len);
 
+	return done;
 }
 
 /*************************************************************************
@@ -321,14 +1031,21 @@ int _write(int fd, const char *ptr, int len)
  *************************************************************************/
 int _close(int fd)
 {
-	int ret;
+	int ret, werr = 0;
+	struct rpmsg_rpc_read_cache *cache;
 	struct rpmsg_rpc_syscall syscall;
 	struct rpmsg_rpc_syscall resp;
 	int payload_size = sizeof(syscall);
-	struct rpmsg_rpc_data *rpc = rpmsg_default_rpc;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
 
 	if (!rpc)
 		return -EINVAL;
+	if (rpc->write_mode != RPMSG_RPC_WRITE_SYNC)
+		werr = rpmsg_rpc_flush(rpc);
+	metal_mutex_acquire(&rpc->lock);
+	cache = rpmsg_rpc_read_cache_find(rpc, fd);
+	metal_mutex_release(&rpc->lock);
+	rpmsg_rpc_read_cache_release(rpc, cache);
 	syscall.id = CLOSE_SYSCALL_ID;
 	syscall.args.int_field1 = fd;
 	syscall.args.int_field2 = 0;	/*not used */
@@ -345,5 +1062,282 @@ int _close(int fd)
 			ret = -EINVAL;
 	}
 
+	return ret < 0 || !werr ? ret : werr;
+}
+
+/* Send a request answered with a count, as WRITE */
+static int rpmsg_rpc_send_count(struct rpmsg_rpc_data *rpc,
+				void *req, size_t len)
+{
+	struct rpmsg_rpc_syscall *syscall = req;
+	struct rpmsg_rpc_syscall resp;
+	uint32_t id = syscall->id;
+	int ret;
+
+	resp.id = 0;
+	ret = rpmsg_rpc_send(rpc, req, len, (void *)&resp, sizeof(resp));
+	if (ret >= 0) {
+		if (resp.id == id)
+			ret = resp.args.int_field1;
+		else
+			ret = -EINVAL;
+	}
+
 	return ret;
 }
+
+/* Send a request answered with data, as READ, and scatter the data */
+static int rpmsg_rpc_send_scatter(struct rpmsg_rpc_data *rpc,
+				  void *req, size_t len,
+				  const struct rpmsg_rpc_iovec *iov,
+				  int iovcnt)
+{
+	struct rpmsg_rpc_syscall *syscall = req;
+	struct rpmsg_rpc_syscall *resp;
+	unsigned char tmpbuf[MAX_BUF_LEN];
+	uint32_t id = syscall->id;
+	uint32_t n, part, done = 0;
+	int ret, i;
+
+	resp = (void *)tmpbuf;
+	resp->id = 0;
+	ret = rpmsg_rpc_send(rpc, req, len, tmpbuf, sizeof(tmpbuf));
+	if (ret < 0)
+		return ret;
+	if (resp->id != id)
+		return -EINVAL;
+	if (resp->args.int_field1 <= 0)
+		return resp->args.int_field1;
+
+	n = resp->args.int_field1;
+	if (n > resp->args.data_len)
+		n = resp->args.data_len;
+	if (n > sizeof(tmpbuf) - sizeof(*resp))
+		n = sizeof(tmpbuf) - sizeof(*resp);
+	for (i = 0; i < iovcnt && done < n; i++) {
+		part = n - done;
+		if (part > iov[i].iov_len)
+			part = iov[i].iov_len;
+		memcpy(iov[i].iov_base, tmpbuf + sizeof(*resp) + done, part);
+		done += part;
+	}
+
+	return done;
+}
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _pread
+ *
+ *   DESCRIPTION
+ *
+ *       Read from a file at an offset.
+ *
+ *************************************************************************/
+int _pread(int fd, char *buffer, int buflen, off_t offset)
+{
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	unsigned char tmpbuf[sizeof(struct rpmsg_rpc_syscall) +
+			     sizeof(int64_t)];
+	struct rpmsg_rpc_syscall *syscall = (void *)tmpbuf;
+	struct rpmsg_rpc_iovec iov;
+	int64_t off;
+	int chunk, done = 0;
+	int ret;
+
+	if (!rpc || !buffer || buflen <= 0)
+		return -EINVAL;
+
+	/* Read in chunks fitting in the answer buffer */
+	do {
+		chunk = buflen - done;
+		if (chunk > (int)(MAX_BUF_LEN - sizeof(*syscall)))
+			chunk = MAX_BUF_LEN - sizeof(*syscall);
+		off = offset + done;
+		syscall->id = PREAD_SYSCALL_ID;
+		syscall->args.int_field1 = fd;
+		syscall->args.int_field2 = chunk;
+		syscall->args.data_len = sizeof(off);
+		memcpy(syscall + 1, &off, sizeof(off));
+		iov.iov_base = buffer + done;
+		iov.iov_len = chunk;
+		ret = rpmsg_rpc_send_scatter(rpc, tmpbuf, sizeof(tmpbuf),
+					     &iov, 1);
+		if (ret < 0)
+			return done ? done : ret;
+		done += ret;
+	} while (ret == chunk && done < buflen);
+
+	return done;
+}
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _pwrite
+ *
+ *   DESCRIPTION
+ *
+ *       Write to a file at an offset.
+ *
+ *************************************************************************/
+int _pwrite(int fd, const char *ptr, int len, off_t offset)
+{
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	unsigned char tmpbuf[MAX_BUF_LEN];
+	struct rpmsg_rpc_syscall *syscall = (void *)tmpbuf;
+	unsigned char *tmpptr = tmpbuf + sizeof(*syscall) + sizeof(int64_t);
+	int64_t off;
+	int chunk, done = 0;
+	int ret;
+
+	if (!rpc || !ptr || len < 0)
+		return -EINVAL;
+
+	/* Send the data in chunks fitting in the request buffer */
+	do {
+		chunk = len - done;
+		if (chunk > (int)(sizeof(tmpbuf) - (tmpptr - tmpbuf)))
+			chunk = sizeof(tmpbuf) - (tmpptr - tmpbuf);
+		off = offset + done;
+		syscall->id = PWRITE_SYSCALL_ID;
+		syscall->args.int_field1 = fd;
+		syscall->args.int_field2 = chunk;
+		syscall->args.data_len = sizeof(off) + chunk;
+		memcpy(syscall + 1, &off, sizeof(off));
+		memcpy(tmpptr, ptr + done, chunk);
+		ret = rpmsg_rpc_send_count(rpc, tmpbuf, (tmpptr - tmpbuf) + chunk);
+		if (ret < 0)
+			return done ? done : ret;
+		done += ret;
+	} while (ret == chunk && done < len);
+
+	return done;
+}
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _readv
+ *
+ *   DESCRIPTION
+ *
+ *       Read from a file into several buffers.
+ *
+ *************************************************************************/
+int _readv(int fd, const struct rpmsg_rpc_iovec *iov, int iovcnt)
+{
+	struct rpmsg_rpc_read_cache *cache;
+	struct rpmsg_rpc_syscall syscall;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	size_t total = 0;
+	int ret = 0, done = 0, i;
+
+	if (!rpc || !iov || iovcnt <= 0)
+		return -EINVAL;
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	metal_mutex_acquire(&rpc->lock);
+	cache = rpmsg_rpc_read_cache_find(rpc, fd);
+	metal_mutex_release(&rpc->lock);
+	if (cache) {
+		/* Serve the vectors from the read-ahead cache */
+		for (i = 0; i < iovcnt; i++) {
+			if (!iov[i].iov_len)
+				continue;
+			ret = rpmsg_rpc_read_cached(rpc, cache, iov[i].iov_base,
+						    iov[i].iov_len);
+			if (ret <= 0)
+				break;
+			done += ret;
+			if ((size_t)ret < iov[i].iov_len)
+				break;
+		}
+		return done ? done : ret;
+	}
+
+	if (total > MAX_BUF_LEN - sizeof(syscall))
+		total = MAX_BUF_LEN - sizeof(syscall);
+	syscall.id = READV_SYSCALL_ID;
+	syscall.args.int_field1 = fd;
+	syscall.args.int_field2 = total;
+	syscall.args.data_len = 0;	/*not used */
+
+	return rpmsg_rpc_send_scatter(rpc, &syscall, sizeof(syscall),
+				      iov, iovcnt);
+}
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _writev
+ *
+ *   DESCRIPTION
+ *
+ *       Write to a file from several buffers.
+ *
+ *************************************************************************/
+int _writev(int fd, const struct rpmsg_rpc_iovec *iov, int iovcnt)
+{
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	unsigned char tmpbuf[MAX_BUF_LEN];
+	struct rpmsg_rpc_syscall *syscall = (void *)tmpbuf;
+	unsigned char *tmpptr = tmpbuf + sizeof(*syscall);
+	size_t room = sizeof(tmpbuf) - sizeof(*syscall);
+	size_t off = 0, part;
+	int ret = 0, done = 0, chunk, i = 0;
+
+	if (!rpc || !iov || iovcnt <= 0)
+		return -EINVAL;
+
+	if (rpc->write_mode != RPMSG_RPC_WRITE_SYNC) {
+		/* Gather the vectors in the TX buffer of the async writes */
+		for (i = 0; i < iovcnt; i++) {
+			ret = rpmsg_rpc_write_async(rpc, fd, iov[i].iov_base,
+						    iov[i].iov_len);
+			if (ret < 0)
+				break;
+			done += ret;
+		}
+		return done ? done : ret;
+	}
+
+	/* Gather the vectors in requests as full as possible */
+	while (i < iovcnt) {
+		chunk = 0;
+		while (i < iovcnt && (size_t)chunk < room) {
+			part = iov[i].iov_len - off;
+			if (part > room - chunk)
+				part = room - chunk;
+			memcpy(tmpptr + chunk, (char *)iov[i].iov_base + off,
+			       part);
+			chunk += part;
+			off += part;
+			if (off == iov[i].iov_len) {
+				off = 0;
+				i++;
+			}
+		}
+		if (!chunk)
+			break;
+		syscall->id = WRITEV_SYSCALL_ID;
+		syscall->args.int_field1 = fd;
+		syscall->args.int_field2 = chunk;
+		syscall->args.data_len = chunk;
+		ret = rpmsg_rpc_send_count(rpc, tmpbuf,
+					   sizeof(*syscall) + chunk);
+		if (ret < 0)
+			return done ? done : ret;
+		done += ret;
+		if (ret < chunk)
+			break;
+	}
+
+	return done;
+}
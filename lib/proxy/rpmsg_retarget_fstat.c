@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <openamp/rpmsg_retarget.h>
+#include <string.h>
+
+#include "rpmsg_retarget_internal.h"
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _fstat
+ *
+ *   DESCRIPTION
+ *
+ *       Get the status of a file.
+ *
+ *************************************************************************/
+int _fstat(int fd, struct stat *st)
+{
+	struct rpmsg_rpc_syscall syscall;
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	unsigned char respbuf[sizeof(syscall) + sizeof(struct rpmsg_rpc_stat)];
+	struct rpmsg_rpc_syscall *resp = (void *)respbuf;
+	struct rpmsg_rpc_stat rst;
+	int ret;
+
+	if (!rpc || !st)
+		return -EINVAL;
+
+	syscall.id = FSTAT_SYSCALL_ID;
+	syscall.args.int_field1 = fd;
+	syscall.args.int_field2 = 0;	/*not used */
+	syscall.args.data_len = 0;	/*not used */
+
+	resp->id = 0;
+	ret = rpmsg_rpc_send(rpc, (void *)&syscall, sizeof(syscall),
+			     respbuf, sizeof(respbuf));
+	if (ret >= 0) {
+		if (resp->id != FSTAT_SYSCALL_ID)
+			return -EINVAL;
+		if (resp->args.int_field1 < 0)
+			return resp->args.int_field1;
+		memcpy(&rst, resp + 1, sizeof(rst));
+		memset(st, 0, sizeof(*st));
+		st->st_mode = rst.mode;
+		st->st_size = rst.size;
+		ret = 0;
+	}
+
+	return ret;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _RPMSG_RETARGET_INTERNAL_H_
+#define _RPMSG_RETARGET_INTERNAL_H_
+
+#include <stdint.h>
+#include <openamp/rpmsg_retarget.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @internal
+ *
+ * @brief Get the RPC data of a file descriptor
+ *
+ * @param fd	File descriptor, -1 for _open()
+ *
+ * @return The RPC data chosen by the selection function, or the default one.
+ */
+struct rpmsg_rpc_data *rpmsg_rpc_get(int fd);
+
+/**
+ * @internal
+ *
+ * @brief Drop the data read ahead for a file descriptor
+ *
+ * The pending read-ahead answers are waited for first.
+ *
+ * @param rpc	Pointer to the RPC data
+ * @param fd	File descriptor
+ *
+ * @return Number of bytes dropped, 0 if the file has no read-ahead cache.
+ */
+uint32_t rpmsg_rpc_read_cache_drop(struct rpmsg_rpc_data *rpc, int fd);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif /* _RPMSG_RETARGET_INTERNAL_H_ */
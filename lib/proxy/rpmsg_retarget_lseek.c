@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <openamp/rpmsg_retarget.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rpmsg_retarget_internal.h"
+
+/*************************************************************************
+ *
+ *   FUNCTION
+ *
+ *       _lseek
+ *
+ *   DESCRIPTION
+ *
+ *       Reposition the offset of a file.
+ *
+ *************************************************************************/
+off_t _lseek(int fd, off_t offset, int whence)
+{
+	struct rpmsg_rpc_data *rpc = rpmsg_rpc_get(fd);
+	unsigned char tmpbuf[sizeof(struct rpmsg_rpc_syscall) +
+			     sizeof(int64_t)];
+	struct rpmsg_rpc_syscall *syscall = (void *)tmpbuf;
+	unsigned char respbuf[sizeof(tmpbuf)];
+	struct rpmsg_rpc_syscall *resp = (void *)respbuf;
+	int64_t off = offset;
+	uint32_t dropped;
+	int ret;
+
+	if (!rpc)
+		return -EINVAL;
+
+	/* The remote offset is after the data read ahead, drop it */
+	dropped = rpmsg_rpc_read_cache_drop(rpc, fd);
+	if (whence == SEEK_CUR)
+		off -= dropped;
+
+	syscall->id = LSEEK_SYSCALL_ID;
+	syscall->args.int_field1 = fd;
+	syscall->args.int_field2 = whence;
+	syscall->args.data_len = sizeof(off);
+	memcpy(syscall + 1, &off, sizeof(off));
+
+	resp->id = 0;
+	ret = rpmsg_rpc_send(rpc, tmpbuf, sizeof(tmpbuf),
+			     respbuf, sizeof(respbuf));
+	if (ret >= 0) {
+		if (resp->id != LSEEK_SYSCALL_ID)
+			return -EINVAL;
+		if (resp->args.int_field1 < 0)
+			return resp->args.int_field1;
+		memcpy(&off, resp + 1, sizeof(off));
+		/* off_t is 32-bit in some C libraries */
+		if ((off_t)off != off)
+			return -EOVERFLOW;
+		return off;
+	}
+
+	return ret;
+}
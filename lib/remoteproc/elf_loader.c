@@ -6,6 +6,7 @@
  */
 
 #include <string.h>
+#include <internal/utilities.h>
 #include <metal/alloc.h>
 #include <metal/log.h>
 #include <openamp/elf_loader.h>
@@ -122,6 +123,32 @@ static int elf_shstrndx(const void *elf_info)
 	}
 }
 
+static unsigned int elf_type(const void *elf_info)
+{
+	if (elf_is_64(elf_info) == 0) {
+		const Elf32_Ehdr *ehdr = elf_info;
+
+		return ehdr->e_type;
+	} else {
+		const Elf64_Ehdr *ehdr = elf_info;
+
+		return ehdr->e_type;
+	}
+}
+
+static unsigned int elf_machine(const void *elf_info)
+{
+	if (elf_is_64(elf_info) == 0) {
+		const Elf32_Ehdr *ehdr = elf_info;
+
+		return ehdr->e_machine;
+	} else {
+		const Elf64_Ehdr *ehdr = elf_info;
+
+		return ehdr->e_machine;
+	}
+}
+
 static void **elf_phtable_ptr(void *elf_info)
 {
 	if (elf_is_64(elf_info) == 0) {
@@ -174,6 +201,58 @@ static int *elf_load_state(void *elf_info)
 	}
 }
 
+static int *elf_tables_mapped(void *elf_info)
+{
+	if (elf_is_64(elf_info) == 0) {
+		struct elf32_info *einfo = elf_info;
+
+		return &einfo->mapped;
+	} else {
+		struct elf64_info *einfo = elf_info;
+
+		return &einfo->mapped;
+	}
+}
+
+static struct elf_section_hash *elf_section_hash(void *elf_info)
+{
+	if (elf_is_64(elf_info) == 0) {
+		struct elf32_info *einfo = elf_info;
+
+		return &einfo->shash;
+	} else {
+		struct elf64_info *einfo = elf_info;
+
+		return &einfo->shash;
+	}
+}
+
+static struct remoteproc_reloc *elf_reloc(void *elf_info)
+{
+	if (elf_is_64(elf_info) == 0) {
+		struct elf32_info *einfo = elf_info;
+
+		return &einfo->reloc;
+	} else {
+		struct elf64_info *einfo = elf_info;
+
+		return &einfo->reloc;
+	}
+}
+
+static unsigned int elf_segment_flags(void *elf_info, const void *elf_phdr)
+{
+	if (elf_is_64(elf_info) == 0) {
+		const Elf32_Phdr *phdr = elf_phdr;
+
+		return phdr->p_flags;
+	} else {
+		const Elf64_Phdr *phdr = elf_phdr;
+
+		return phdr->p_flags;
+	}
+}
+
 static void elf_parse_segment(void *elf_info, const void *elf_phdr,
 			      unsigned int *p_type, size_t *p_offset,
 			      metal_phys_addr_t *p_vaddr,
@@ -238,10 +317,90 @@ static const void *elf_get_segment_from_index(void *elf_info, int index)
 	}
 }
 
+static size_t elf_section_name(void *elf_info, const void *elf_shdr)
+{
+	if (elf_is_64(elf_info) == 0) {
+		const Elf32_Shdr *shdr = elf_shdr;
+
+		return shdr->sh_name;
+	} else {
+		const Elf64_Shdr *shdr = elf_shdr;
+
+		return shdr->sh_name;
+	}
+}
+
+/* Hash of a section name, up to its NUL or max characters */
+static uint32_t elf_name_hash(const char *name, size_t max)
+{
+	size_t len = 0;
+
+	while (len < max && name[len])
+		len++;
+
+	return fnv1a_hash32(FNV1A_HASH32_INIT, name, len);
+}
+
+static void *elf_get_section_from_index(void *elf_info, int index);
+
+/*
+ * Build the section name hash table once the section headers and names are
+ * loaded, the lookups scan the section headers if it cannot be allocated
+ */
+static void elf_hash_sections(void *elf_info, size_t shstrtab_size)
+{
+	struct elf_section_hash *shash = elf_section_hash(elf_info);
+	const char *name_table = *elf_shstrtab_ptr(elf_info);
+	int shnum = elf_shnum(elf_info);
+	unsigned int size = 2, slot;
+	size_t sh_name;
+	int i;
+
+	if (!name_table || shnum <= 0 || shash->slots)
+		return;
+	while (size < (unsigned int)shnum * 2)
+		size <<= 1;
+	shash->slots = metal_allocate_memory(size * sizeof(*shash->slots));
+	if (!shash->slots)
+		return;
+	memset(shash->slots, 0, size * sizeof(*shash->slots));
+	shash->mask = size - 1;
+
+	/* Same names keep the section header order along the probes */
+	for (i = 0; i < shnum; i++) {
+		sh_name = elf_section_name(elf_info,
+					   elf_get_section_from_index(elf_info,
+								      i));
+		if (sh_name >= shstrtab_size)
+			continue;
+		slot = elf_name_hash(name_table + sh_name,
+				     shstrtab_size - sh_name) & shash->mask;
+		while (shash->slots[slot])
+			slot = (slot + 1) & shash->mask;
+		shash->slots[slot] = (unsigned short)(i + 1);
+	}
+}
+
 static void *elf_get_section_from_name(void *elf_info, const char *name)
 {
 	unsigned int i;
 	const char *name_table;
+	struct elf_section_hash *shash = elf_section_hash(elf_info);
+
+	if (shash->slots) {
+		void *shdr;
+
+		name_table = *elf_shstrtab_ptr(elf_info);
+		for (i = elf_name_hash(name, (size_t)-1) & shash->mask;
+		     shash->slots[i]; i = (i + 1) & shash->mask) {
+			shdr = elf_get_section_from_index(elf_info,
+							  shash->slots[i] - 1);
+			if (shdr && !strcmp(name, name_table +
+					    elf_section_name(elf_info, shdr)))
+				return shdr;
+		}
+		return NULL;
+	}
 
 	if (elf_is_64(elf_info) == 0) {
 		struct elf32_info *einfo = elf_info;
@@ -370,10 +529,298 @@ static const void *elf_next_load_segment(void *elf_info, int *nseg,
 		elf_parse_segment(elf_info, phdr, &p_type, noffset,
 				  NULL, da, nfsize, nmsize);
 		*nseg = *nseg + 1;
+		/* Already loaded by an instance sharing it */
+		if (p_type == PT_LOAD && elf_reloc(elf_info)->ro_shared &&
+		    (elf_segment_flags(elf_info, phdr) & PF_W) == 0)
+			p_type = PT_NULL;
 	}
 	return phdr;
 }
 
+/*
+ * Loadable segment containing a link address, NULL if none. With end set,
+ * an address one past the end of a segment, such as _end or the start of
+ * the heap, belongs to that segment when no segment contains it.
+ */
+static const void *elf_find_segment(void *elf_info, metal_phys_addr_t addr,
+				    int end)
+{
+	const void *phdr, *end_phdr = NULL;
+	unsigned int p_type;
+	metal_phys_addr_t vaddr;
+	size_t memsz;
+	int i;
+
+	for (i = 0; i < elf_phnum(elf_info); i++) {
+		phdr = elf_get_segment_from_index(elf_info, i);
+		if (!phdr)
+			break;
+		elf_parse_segment(elf_info, phdr, &p_type, NULL, &vaddr, NULL,
+				  NULL, &memsz);
+		if (p_type != PT_LOAD || addr < vaddr)
+			continue;
+		if (addr - vaddr < memsz)
+			return phdr;
+		if (end && !end_phdr && addr - vaddr == memsz)
+			end_phdr = phdr;
+	}
+	return end_phdr;
+}
+
+/* Offset of a segment from its link address, depends on its write access */
+static metal_phys_addr_t elf_segment_offset(void *elf_info, const void *phdr)
+{
+	const struct remoteproc_reloc *reloc = elf_reloc(elf_info);
+
+	if (phdr && (elf_segment_flags(elf_info, phdr) & PF_W) != 0)
+		return reloc->rw_offset;
+	return reloc->ro_offset;
+}
+
+/* Address of a link address once the image is placed */
+static metal_phys_addr_t elf_reloc_addr(void *elf_info,
+					metal_phys_addr_t addr)
+{
+	return addr + elf_segment_offset(elf_info,
+					 elf_find_segment(elf_info, addr, 1));
+}
+
+/* Map the loaded data at a link address in the target memory */
+static void *elf_map_addr(struct remoteproc *rproc, void *elf_info,
+			  metal_phys_addr_t addr, size_t size,
+			  struct metal_io_region **io)
+{
+	const void *phdr = elf_find_segment(elf_info, addr, 0);
+	metal_phys_addr_t vaddr, da;
+
+	if (!phdr)
+		return NULL;
+	elf_parse_segment(elf_info, phdr, NULL, NULL, &vaddr, &da, NULL, NULL);
+	da += addr - vaddr + elf_segment_offset(elf_info, phdr);
+
+	return remoteproc_mmap(rproc, NULL, &da, size, 0, io);
+}
+
+/* Relative relocation code of the image machine, 0 if not supported */
+static unsigned long elf_relative_type(void *elf_info)
+{
+	switch (elf_machine(elf_info)) {
+	case EM_ARM:
+		return R_ARM_RELATIVE;
+	case EM_AARCH64:
+		return R_AARCH64_RELATIVE;
+	case EM_RISCV:
+		return R_RISCV_RELATIVE;
+	default:
+		return 0;
+	}
+}
+
+/* Apply a relocation to the loaded image */
+static int elf_apply_reloc(struct remoteproc *rproc, void *elf_info,
+			   metal_phys_addr_t where, unsigned long type,
+			   uint64_t addend, int has_addend)
+{
+	struct metal_io_region *io = NULL;
+	const void *phdr;
+	unsigned long offset;
+	size_t size;
+	void *va;
+
+	/* The NONE relocation code is 0 for all the machines */
+	if (type == 0)
+		return 0;
+	if (type != elf_relative_type(elf_info)) {
+		metal_log(METAL_LOG_ERROR,
+			  "unsupported relocation %lu at 0x%lx\r\n",
+			  type, where);
+		return -RPROC_EINVAL;
+	}
+
+	phdr = elf_find_segment(elf_info, where, 0);
+	if (phdr && elf_reloc(elf_info)->ro_shared &&
+	    (elf_segment_flags(elf_info, phdr) & PF_W) == 0)
+		/* Relocated by the instance which loaded it */
+		return 0;
+
+	size = elf_is_64(elf_info) ? sizeof(Elf64_Addr) : sizeof(Elf32_Addr);
+	va = elf_map_addr(rproc, elf_info, where, size, &io);
+	if (!va || !io) {
+		metal_log(METAL_LOG_ERROR,
+			  "relocation at 0x%lx out of the image\r\n", where);
+		return -RPROC_EINVAL;
+	}
+	offset = metal_io_virt_to_offset(io, va);
+	if (elf_is_64(elf_info) == 0) {
+		if (!has_addend)
+			addend = metal_io_read32(io, offset);
+		addend = elf_reloc_addr(elf_info, (metal_phys_addr_t)addend);
+		metal_io_write32(io, offset, (uint32_t)addend);
+	} else {
+		if (!has_addend)
+			addend = metal_io_read64(io, offset);
+		addend = elf_reloc_addr(elf_info, (metal_phys_addr_t)addend);
+		metal_io_write64(io, offset, addend);
+	}
+
+	return 0;
+}
+
+/* Apply the relocations of a relocation table of the loaded image */
+static int elf_apply_relocs(struct remoteproc *rproc, void *elf_info,
+			    metal_phys_addr_t addr, size_t size,
+			    size_t entsize, int has_addend)
+{
+	struct metal_io_region *io = NULL;
+	unsigned long offset;
+	size_t i;
+	void *va;
+	int ret;
+
+	if (size == 0)
+		return 0;
+	if (elf_is_64(elf_info) == 0)
+		ret = entsize < (has_addend ? sizeof(Elf32_Rela) :
+				 sizeof(Elf32_Rel));
+	else
+		ret = entsize < (has_addend ? sizeof(Elf64_Rela) :
+				 sizeof(Elf64_Rel));
+	va = elf_map_addr(rproc, elf_info, addr, size, &io);
+	if (ret || !va || !io) {
+		metal_log(METAL_LOG_ERROR,
+			  "cannot read relocations at 0x%lx\r\n", addr);
+		return -RPROC_EINVAL;
+	}
+	offset = metal_io_virt_to_offset(io, va);
+
+	for (i = 0; i + entsize <= size; i += entsize) {
+		if (elf_is_64(elf_info) == 0) {
+			Elf32_Rela rel;
+
+			rel.r_addend = 0;
+			metal_io_block_read(io, offset + i, &rel,
+					    has_addend ? sizeof(Elf32_Rela) :
+					    sizeof(Elf32_Rel));
+			ret = elf_apply_reloc(rproc, elf_info, rel.r_offset,
+					      ELF32_R_TYPE(rel.r_info),
+					      (uint32_t)rel.r_addend,
+					      has_addend);
+		} else {
+			Elf64_Rela rel;
+
+			rel.r_addend = 0;
+			metal_io_block_read(io, offset + i, &rel,
+					    has_addend ? sizeof(Elf64_Rela) :
+					    sizeof(Elf64_Rel));
+			ret = elf_apply_reloc(rproc, elf_info, rel.r_offset,
+					      ELF64_R_TYPE(rel.r_info),
+					      rel.r_addend, has_addend);
+		}
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Relocate a loaded position-independent image, with the relocation tables
+ * of its dynamic segment
+ */
+static int elf_relocate(struct remoteproc *rproc, void *elf_info)
+{
+	metal_phys_addr_t dyn_addr = 0, rel_addr = 0, rela_addr = 0;
+	size_t dyn_size = 0, rel_size = 0, rela_size = 0;
+	size_t rel_ent = 0, rela_ent = 0;
+	struct metal_io_region *io = NULL;
+	unsigned int p_type = PT_NULL;
+	unsigned long offset;
+	size_t dyn_ent, i;
+	const void *phdr;
+	int64_t tag;
+	uint64_t val;
+	void *va;
+	int ret, nseg;
+
+	if (!rproc || elf_type(elf_info) != ET_DYN)
+		return 0;
+
+	for (nseg = 0; p_type != PT_DYNAMIC; nseg++) {
+		phdr = elf_get_segment_from_index(elf_info, nseg);
+		if (!phdr)
+			return 0;
+		elf_parse_segment(elf_info, phdr, &p_type, NULL, &dyn_addr,
+				  NULL, &dyn_size, NULL);
+	}
+	if (dyn_size == 0)
+		return 0;
+
+	dyn_ent = elf_is_64(elf_info) ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+	va = elf_map_addr(rproc, elf_info, dyn_addr, dyn_size, &io);
+	if (!va || !io) {
+		metal_log(METAL_LOG_ERROR,
+			  "cannot read dynamic segment at 0x%lx\r\n",
+			  dyn_addr);
+		return -RPROC_EINVAL;
+	}
+	offset = metal_io_virt_to_offset(io, va);
+	for (i = 0; i + dyn_ent <= dyn_size; i += dyn_ent) {
+		if (elf_is_64(elf_info) == 0) {
+			Elf32_Dyn dyn;
+
+			metal_io_block_read(io, offset + i, &dyn, sizeof(dyn));
+			tag = dyn.d_tag;
+			val = dyn.d_un.d_val;
+		} else {
+			Elf64_Dyn dyn;
+
+			metal_io_block_read(io, offset + i, &dyn, sizeof(dyn));
+			tag = dyn.d_tag;
+			val = dyn.d_un.d_val;
+		}
+		if (tag == DT_NULL)
+			break;
+		else if (tag == DT_REL)
+			rel_addr = (metal_phys_addr_t)val;
+		else if (tag == DT_RELSZ)
+			rel_size = (size_t)val;
+		else if (tag == DT_RELENT)
+			rel_ent = (size_t)val;
+		else if (tag == DT_RELA)
+			rela_addr = (metal_phys_addr_t)val;
+		else if (tag == DT_RELASZ)
+			rela_size = (size_t)val;
+		else if (tag == DT_RELAENT)
+			rela_ent = (size_t)val;
+	}
+
+	metal_log(METAL_LOG_DEBUG, "relocating image: rel %d, rela %d\r\n",
+		  (int)rel_size, (int)rela_size);
+	ret = elf_apply_relocs(rproc, elf_info, rel_addr, rel_size, rel_ent,
+			       0);
+	if (ret < 0)
+		return ret;
+
+	return elf_apply_relocs(rproc, elf_info, rela_addr, rela_size,
+				rela_ent, 1);
+}
+
+/* Take the image placement of the remoteproc instance before any load */
+static int elf_set_reloc(struct remoteproc *rproc, void *elf_info)
+{
+	struct remoteproc_reloc *reloc = elf_reloc(elf_info);
+
+	*reloc = rproc->reloc;
+	if ((reloc->ro_offset || reloc->rw_offset) &&
+	    elf_type(elf_info) != ET_DYN) {
+		metal_log(METAL_LOG_ERROR,
+			  "image is not position-independent\r\n");
+		return -RPROC_EINVAL;
+	}
+
+	return 0;
+}
+
 static size_t elf_info_size(const void *img_data)
 {
 	if (elf_is_64(img_data) == 0)
@@ -523,6 +970,7 @@ int elf_load_header(const void *img_data, size_t offset, size_t len,
 		memcpy(*shstrtab,
 		       (const char *)img_data + shstrtab_offset,
 		       shstrtab_size);
+		elf_hash_sections(*img_info, shstrtab_size);
 		*load_state = (*load_state & (~ELF_STATE_MASK)) |
 			       ELF_STATE_HDRS_COMPLETE;
 		*nlen = 0;
@@ -531,6 +979,95 @@ int elf_load_header(const void *img_data, size_t offset, size_t len,
 	return last_load_state;
 }
 
+int elf_load_header_mapped(const void *img_data, size_t len,
+			   void **img_info)
+{
+	const char *img = img_data;
+	size_t phoff, phentsize, shoff, shentsize;
+	size_t str_offset, str_size;
+	size_t p_offset, p_filesz;
+	unsigned int p_type;
+	int phnum, shnum, shstrndx, i;
+	size_t align, ent_phdr, ent_shdr;
+	void *shdr = NULL;
+
+	metal_assert(img_info);
+	if (elf_identify(img_data, len) != 0 || len < sizeof(Elf32_Ehdr) ||
+	    len < elf_ehdr_size(img_data))
+		return -RPROC_EINVAL;
+
+	metal_log(METAL_LOG_DEBUG, "Loading mapped ELF headers\r\n");
+	if (elf_is_64(img_data) == 0) {
+		align = sizeof(Elf32_Addr);
+		ent_phdr = sizeof(Elf32_Phdr);
+		ent_shdr = sizeof(Elf32_Shdr);
+	} else {
+		align = sizeof(Elf64_Addr);
+		ent_phdr = sizeof(Elf64_Phdr);
+		ent_shdr = sizeof(Elf64_Shdr);
+	}
+	phoff = elf_phoff(img_data);
+	phentsize = elf_phentsize(img_data);
+	phnum = elf_phnum(img_data);
+	shoff = elf_shoff(img_data);
+	shentsize = elf_shentsize(img_data);
+	shnum = elf_shnum(img_data);
+	shstrndx = elf_shstrndx(img_data);
+
+	/* The tables are used in place as arrays of the ELF structures */
+	if (phentsize != ent_phdr || (shnum && shentsize != ent_shdr) ||
+	    ((uintptr_t)(img + phoff) & (align - 1)) != 0 ||
+	    ((uintptr_t)(img + shoff) & (align - 1)) != 0)
+		return -RPROC_EAGAIN;
+	if (phoff > len || (size_t)phnum * phentsize > len - phoff)
+		return -RPROC_EINVAL;
+	if (shnum) {
+		if (shoff > len || (size_t)shnum * shentsize > len - shoff ||
+		    shstrndx >= shnum)
+			return -RPROC_EINVAL;
+		shdr = (void *)(img + shoff + shstrndx * shentsize);
+		elf_parse_section((void *)img_data, shdr, NULL, NULL, NULL,
+				  &str_offset, &str_size, NULL, NULL, NULL,
+				  NULL);
+		if (str_offset > len || str_size > len - str_offset)
+			return -RPROC_EINVAL;
+	}
+
+	/* Check the segment data is in the image before any is loaded */
+	for (i = 0; i < phnum; i++) {
+		elf_parse_segment((void *)img_data, img + phoff + i * phentsize,
+				  &p_type, &p_offset, NULL, NULL, &p_filesz,
+				  NULL);
+		if (p_type == PT_LOAD &&
+		    (p_offset > len || p_filesz > len - p_offset)) {
+			metal_log(METAL_LOG_ERROR,
+				  "segment %d out of the image\r\n", i);
+			return -RPROC_EINVAL;
+		}
+	}
+
+	if (!*img_info) {
+		size_t infosize = elf_info_size(img_data);
+
+		*img_info = metal_allocate_memory(infosize);
+		if (!*img_info)
+			return -RPROC_ENOMEM;
+		memset(*img_info, 0, infosize);
+	}
+	memcpy(*img_info, img_data, elf_ehdr_size(img_data));
+	*elf_phtable_ptr(*img_info) = (void *)(img + phoff);
+	if (shdr) {
+		*elf_shtable_ptr(*img_info) = (void *)(img + shoff);
+		*elf_shstrtab_ptr(*img_info) = (void *)(img + str_offset);
+		elf_hash_sections(*img_info, str_size);
+	}
+	*elf_tables_mapped(*img_info) = 1;
+	*elf_load_state(*img_info) = ELF_STATE_HDRS_COMPLETE |
+				     RPROC_LOADER_READY_TO_LOAD;
+
+	return *elf_load_state(*img_info);
+}
+
 int elf_load(struct remoteproc *rproc,
 	     const void *img_data, size_t offset, size_t len,
 	     void **img_info, int last_load_state,
@@ -539,9 +1076,9 @@ int elf_load(struct remoteproc *rproc,
 	     unsigned char *padding, size_t *nmemsize)
 {
 	int *load_state;
-	const void *phdr;
+	const void *phdr = NULL;
+	int ret;
 
-	(void)rproc;
 	metal_assert(da);
 	metal_assert(noffset);
 	metal_assert(nlen);
@@ -563,12 +1100,17 @@ int elf_load(struct remoteproc *rproc,
 	if (padding)
 		*padding = 0;
 	if ((*load_state & RPROC_LOADER_READY_TO_LOAD) != 0) {
-		int nsegment;
+		int nsegment, nnext;
 		size_t nsegmsize = 0;
 		size_t nsize = 0;
 		int phnums = 0;
 
 		nsegment = *load_state & ELF_NEXT_SEGMENT_MASK;
+		if (nsegment == 0 && rproc) {
+			ret = elf_set_reloc(rproc, *img_info);
+			if (ret < 0)
+				return ret;
+		}
 		phdr = elf_next_load_segment(*img_info, &nsegment, da,
 					     noffset, &nsize, &nsegmsize);
 
@@ -576,45 +1118,45 @@ int elf_load(struct remoteproc *rproc,
 		if (phdr) {
 			*nlen = nsize;
 			*nmemsize = nsegmsize;
+			*da += elf_segment_offset(*img_info, phdr);
 			metal_log(METAL_LOG_DEBUG, "segment: %d, total segs %d\r\n",
 				  nsegment, phnums);
 		}
 
-		if (nsegment == phnums) {
-			if (phdr) {
-				*load_state = (*load_state & (~RPROC_LOADER_MASK)) |
+		nnext = nsegment;
+		if (!phdr) {
+			metal_log(METAL_LOG_DEBUG, "no more segment to load\r\n");
+			*load_state = (*load_state & (~RPROC_LOADER_MASK)) |
+				      RPROC_LOADER_POST_DATA_LOAD;
+		} else if (!elf_next_load_segment(*img_info, &nnext, NULL, NULL,
+						  NULL, NULL)) {
+			/* The post-load step waits for the last segment */
+			*load_state = (*load_state & (~RPROC_LOADER_MASK)) |
 				      RPROC_LOADER_POST_DATA_LOAD;
-			} else {
-				metal_log(METAL_LOG_DEBUG, "no more segment to load\r\n");
-				*load_state = (*load_state & (~RPROC_LOADER_MASK)) |
-					RPROC_LOADER_LOAD_COMPLETE;
-					*da = RPROC_LOAD_ANYADDR;
-			}
 		}
 		*load_state = (*load_state & (~ELF_NEXT_SEGMENT_MASK)) |
 			      (nsegment & ELF_NEXT_SEGMENT_MASK);
-	} else if ((*load_state & RPROC_LOADER_POST_DATA_LOAD) != 0) {
+		if (phdr && (elf_segment_flags(*img_info, phdr) & PF_W) == 0)
+			return *load_state | RPROC_LOADER_DATA_RO;
+		if (phdr)
+			return *load_state;
+	}
+	if ((*load_state & RPROC_LOADER_POST_DATA_LOAD) != 0) {
+		*da = RPROC_LOAD_ANYADDR;
 		if ((*load_state & ELF_STATE_HDRS_COMPLETE) == 0) {
-			last_load_state = elf_load_header(img_data, offset,
-							  len, img_info,
-							  last_load_state,
-							  noffset, nlen);
-			if (last_load_state < 0)
-				return last_load_state;
-			if ((last_load_state & ELF_STATE_HDRS_COMPLETE) != 0) {
-				*load_state = (*load_state &
-						(~RPROC_LOADER_MASK)) |
-						RPROC_LOADER_LOAD_COMPLETE;
-				*nlen = 0;
-			}
-			*da = RPROC_LOAD_ANYADDR;
-		} else {
-		/* TODO: will handle relocate later */
-			*nlen = 0;
-			*load_state = (*load_state &
-					(~RPROC_LOADER_MASK)) |
-					RPROC_LOADER_LOAD_COMPLETE;
+			ret = elf_load_header(img_data, offset, len, img_info,
+					      *load_state, noffset, nlen);
+			if (ret < 0)
+				return ret;
+			if ((ret & ELF_STATE_HDRS_COMPLETE) == 0)
+				return *load_state;
 		}
+		ret = elf_relocate(rproc, *img_info);
+		if (ret < 0)
+			return ret;
+		*nlen = 0;
+		*load_state = (*load_state & (~RPROC_LOADER_MASK)) |
+			      RPROC_LOADER_LOAD_COMPLETE;
 	}
 	return *load_state;
 }
@@ -623,7 +1165,12 @@ void elf_release(void *img_info)
 {
 	if (!img_info)
 		return;
-	if (elf_is_64(img_info) == 0) {
+	if (elf_section_hash(img_info)->slots)
+		metal_free_memory(elf_section_hash(img_info)->slots);
+	if (*elf_tables_mapped(img_info) != 0) {
+		/* The tables are in the image */
+		metal_free_memory(img_info);
+	} else if (elf_is_64(img_info) == 0) {
 		struct elf32_info *elf_info = img_info;
 
 		if (elf_info->phdrs)
@@ -657,13 +1204,13 @@ metal_phys_addr_t elf_get_entry(void *elf_info)
 		Elf32_Addr e_entry;
 
 		e_entry = elf_ehdr->e_entry;
-		return (metal_phys_addr_t)e_entry;
+		return elf_reloc_addr(elf_info, (metal_phys_addr_t)e_entry);
 	} else {
 		Elf64_Ehdr *elf_ehdr = elf_info;
 		Elf64_Addr e_entry;
 
 		e_entry = elf_ehdr->e_entry;
-		return (metal_phys_addr_t)e_entry;
+		return elf_reloc_addr(elf_info, (metal_phys_addr_t)e_entry);
 	}
 }
 
@@ -689,6 +1236,8 @@ int elf_locate_rsc_table(void *elf_info, metal_phys_addr_t *da,
 	elf_parse_section(elf_info, shdr, NULL, NULL,
 			  da, offset, size,
 			  NULL, NULL, NULL, NULL);
+	if (da)
+		*da = elf_reloc_addr(elf_info, *da);
 	return 0;
 }
 
@@ -709,4 +1258,5 @@ const struct loader_ops elf_ops = {
 	.release = elf_release,
 	.get_entry = elf_get_entry,
 	.get_load_state = elf_get_load_state,
+	.load_header_mapped = elf_load_header_mapped,
 };
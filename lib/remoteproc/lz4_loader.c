@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include <internal/utilities.h>
+#include <metal/alloc.h>
+#include <metal/io.h>
+#include <metal/log.h>
+#include <metal/utilities.h>
+#include <openamp/elf_loader.h>
+#include <openamp/lz4_loader.h>
+#include <openamp/remoteproc.h>
+
+/* LZ4 frame parsing states */
+#define LZ4_STATE_FRAME_HDR	0
+#define LZ4_STATE_BLOCK_HDR	1
+#define LZ4_STATE_BLOCK		2
+#define LZ4_STATE_END		3
+
+/* LZ4 frame descriptor */
+#define LZ4_FLG_VERSION_MASK	0xC0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CHECKSUM	0x04
+#define LZ4_FLG_DICT_ID		0x01
+#define LZ4_BD_BLOCK_MAX_SHIFT	4
+#define LZ4_BD_BLOCK_MAX_MASK	0x7
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000UL
+
+/* Frame header size: magic, FLG, BD, HC, without content size */
+#define LZ4_FRAME_HDR_SIZE	7
+#define LZ4_CONTENT_SIZE_SIZE	8
+#define LZ4_BLOCK_HDR_SIZE	4
+#define LZ4_CHECKSUM_SIZE	4
+#define LZ4_END_MARK_SIZE	4
+
+/* Minimum length of an LZ4 match */
+#define LZ4_MIN_MATCH		4
+
+/* Loader phases */
+#define LZ4_PHASE_HEADER	0
+#define LZ4_PHASE_DATA		1
+#define LZ4_PHASE_CHECK		2
+
+/**
+ * @internal
+ *
+ * @brief LZ4 compressed ELF image information
+ *
+ * The decompressed image is an ELF image, parsed by the ELF loader. The
+ * requests of the ELF loader, in decompressed image offsets, are served
+ * from the output of the LZ4 blocks decompressed one at a time.
+ */
+struct lz4_info {
+	/** ELF image information */
+	void *elf_info;
+
+	/** ELF loader state */
+	int elf_state;
+
+	/** Loader phase, LZ4_PHASE_* */
+	int phase;
+
+	/** Frame parsing state, LZ4_STATE_* */
+	int state;
+
+	/** Frame descriptor flags */
+	unsigned char flg;
+
+	/** Hash of the decompressed content, for the content checksum */
+	struct xxh32_state chash;
+
+	/** Maximum block output size */
+	size_t block_max;
+
+	/** Offset in the compressed image of the next data to parse */
+	size_t cpos;
+
+	/** Size of the next block, with the LZ4_BLOCK_UNCOMPRESSED flag */
+	unsigned long bsize;
+
+	/** History followed by the block output */
+	unsigned char *buf;
+
+	/** Size of the history before the block output */
+	size_t hist;
+
+	/** Offset in the decompressed image of the block output */
+	size_t dpos;
+
+	/** Size of the block output */
+	size_t dlen;
+
+	/** Non-zero if an ELF loader request is being served */
+	int req_active;
+
+	/** Offset of the request in the decompressed image */
+	size_t roff;
+
+	/** Length of the request */
+	size_t rlen;
+
+	/** Length of the request already served */
+	size_t rdone;
+
+	/** Target address of the request, RPROC_LOAD_ANYADDR for local data */
+	metal_phys_addr_t rpa;
+
+	/** I/O region of the request target memory */
+	struct metal_io_region *rio;
+
+	/** Local buffer of the requests which are not to the target memory */
+	unsigned char *local;
+
+	/** Size of the local buffer */
+	size_t local_size;
+};
+
+static unsigned long lz4_read_le32(const unsigned char *p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+	       ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static int lz4_read_length(const unsigned char **ip, const unsigned char *iend,
+			   size_t *len)
+{
+	unsigned int b;
+
+	do {
+		if (*ip >= iend)
+			return -RPROC_EINVAL;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/*
+ * Decompress an LZ4 block to dst, matches can reference up to hist bytes
+ * before dst. Returns the output size or a negative value on failure.
+ */
+static int lz4_decode_block(const unsigned char *src, size_t slen,
+			    unsigned char *dst, size_t hist, size_t cap)
+{
+	const unsigned char *ip = src;
+	const unsigned char *iend = src + slen;
+	unsigned char *op = dst;
+	unsigned char *oend = dst + cap;
+	size_t lit, mlen, moff;
+	unsigned int token;
+
+	while (ip < iend) {
+		token = *ip++;
+		lit = token >> 4;
+		if (lit == 15 && lz4_read_length(&ip, iend, &lit) < 0)
+			return -RPROC_EINVAL;
+		if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+			return -RPROC_EINVAL;
+		memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+		/* The last sequence only has literals */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -RPROC_EINVAL;
+		moff = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (moff == 0 || moff > (size_t)(op - dst) + hist)
+			return -RPROC_EINVAL;
+		mlen = token & 15;
+		if (mlen == 15 && lz4_read_length(&ip, iend, &mlen) < 0)
+			return -RPROC_EINVAL;
+		mlen += LZ4_MIN_MATCH;
+		if (mlen > (size_t)(oend - op))
+			return -RPROC_EINVAL;
+		if (moff >= mlen) {
+			memcpy(op, op - moff, mlen);
+			op += mlen;
+		} else {
+			/* Overlapping match repeating the last bytes */
+			for (; mlen > 0; mlen--, op++)
+				*op = *(op - moff);
+		}
+	}
+
+	return (int)(op - dst);
+}
+
+static int lz4_parse_frame_hdr(struct lz4_info *info, const unsigned char *p,
+			       size_t size)
+{
+	unsigned int bsid;
+
+	if (lz4_read_le32(p) != LZ4_FRAME_MAGIC)
+		return -RPROC_EINVAL;
+	info->flg = p[4];
+	if ((info->flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+	    (info->flg & LZ4_FLG_DICT_ID) != 0) {
+		metal_log(METAL_LOG_ERROR,
+			  "lz4: unsupported frame flags 0x%x\r\n", info->flg);
+		return -RPROC_EINVAL;
+	}
+	/* The header checksum covers the frame descriptor, from FLG */
+	if (((xxh32(p + 4, size - 5, 0) >> 8) & 0xFF) != p[size - 1]) {
+		metal_log(METAL_LOG_ERROR, "lz4: bad frame header checksum\r\n");
+		return -RPROC_EINVAL;
+	}
+	bsid = (p[5] >> LZ4_BD_BLOCK_MAX_SHIFT) & LZ4_BD_BLOCK_MAX_MASK;
+	if (bsid < 4)
+		return -RPROC_EINVAL;
+	xxh32_init(&info->chash, 0);
+	info->block_max = 1UL << (8 + 2 * bsid);
+
+	if (!info->buf) {
+		info->buf = metal_allocate_memory(LZ4_HISTORY_SIZE +
+						  info->block_max);
+		if (!info->buf)
+			return -RPROC_ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Decompress the next block from the compressed data available at cpos.
+ * Returns 0 once a block is decompressed, 1 if more compressed data is
+ * needed at noffset/nlen, or a negative value on failure.
+ */
+static int lz4_next_block(struct lz4_info *info,
+			  const void *img_data, size_t offset, size_t len,
+			  size_t *noffset, size_t *nlen)
+{
+	const unsigned char *p = NULL;
+	size_t avail = 0;
+	size_t need = 0;
+	size_t clen, keep;
+	int ret;
+
+	while (1) {
+		if (img_data && info->cpos >= offset &&
+		    info->cpos < offset + len) {
+			p = (const unsigned char *)img_data +
+			    (info->cpos - offset);
+			avail = offset + len - info->cpos;
+		} else {
+			avail = 0;
+		}
+
+		switch (info->state) {
+		case LZ4_STATE_FRAME_HDR:
+			need = LZ4_FRAME_HDR_SIZE;
+			if (avail > 4 && (p[4] & LZ4_FLG_CONTENT_SIZE) != 0)
+				need += LZ4_CONTENT_SIZE_SIZE;
+			if (avail < need)
+				goto more;
+			ret = lz4_parse_frame_hdr(info, p, need);
+			if (ret < 0)
+				return ret;
+			info->cpos += need;
+			info->state = LZ4_STATE_BLOCK_HDR;
+			break;
+		case LZ4_STATE_BLOCK_HDR:
+			need = LZ4_BLOCK_HDR_SIZE;
+			if (avail < need)
+				goto more;
+			info->bsize = lz4_read_le32(p);
+			/* End mark, the ELF loader needs more than the image */
+			if (info->bsize == 0 && info->phase != LZ4_PHASE_CHECK) {
+				metal_log(METAL_LOG_ERROR,
+					  "lz4: end of image at 0x%lx\r\n",
+					  info->dpos + info->dlen);
+				return -RPROC_EINVAL;
+			}
+			if (info->bsize == 0) {
+				need = LZ4_END_MARK_SIZE + LZ4_CHECKSUM_SIZE;
+				if (avail < need)
+					goto more;
+				if (lz4_read_le32(p + LZ4_END_MARK_SIZE) !=
+				    xxh32_digest(&info->chash)) {
+					metal_log(METAL_LOG_ERROR,
+						  "lz4: bad content checksum\r\n");
+					return -RPROC_EINVAL;
+				}
+				info->cpos += need;
+				info->state = LZ4_STATE_END;
+				return 0;
+			}
+			if ((info->bsize & ~LZ4_BLOCK_UNCOMPRESSED) >
+			    info->block_max)
+				return -RPROC_EINVAL;
+			info->cpos += need;
+			info->state = LZ4_STATE_BLOCK;
+			break;
+		case LZ4_STATE_BLOCK:
+			clen = info->bsize & ~LZ4_BLOCK_UNCOMPRESSED;
+			need = clen;
+			if ((info->flg & LZ4_FLG_BLOCK_CHECKSUM) != 0)
+				need += LZ4_CHECKSUM_SIZE;
+			if (avail < need) {
+				/* Get the next block header along */
+				need += LZ4_BLOCK_HDR_SIZE;
+				goto more;
+			}
+			if ((info->flg & LZ4_FLG_BLOCK_CHECKSUM) != 0 &&
+			    lz4_read_le32(p + clen) != xxh32(p, clen, 0)) {
+				metal_log(METAL_LOG_ERROR,
+					  "lz4: bad block checksum at 0x%lx\r\n",
+					  info->cpos);
+				return -RPROC_EINVAL;
+			}
+
+			/* Keep the end of the previous output as history */
+			keep = info->hist + info->dlen;
+			if (keep > LZ4_HISTORY_SIZE) {
+				memmove(info->buf,
+					info->buf + keep - LZ4_HISTORY_SIZE,
+					LZ4_HISTORY_SIZE);
+				keep = LZ4_HISTORY_SIZE;
+			}
+			info->hist = keep;
+			info->dpos += info->dlen;
+			info->dlen = 0;
+
+			if ((info->bsize & LZ4_BLOCK_UNCOMPRESSED) != 0) {
+				memcpy(info->buf + info->hist, p, clen);
+				ret = (int)clen;
+			} else {
+				ret = lz4_decode_block(p, clen,
+						       info->buf + info->hist,
+						       info->hist,
+						       info->block_max);
+			}
+			if (ret < 0) {
+				metal_log(METAL_LOG_ERROR,
+					  "lz4: corrupted block at 0x%lx\r\n",
+					  info->cpos);
+				return ret;
+			}
+			info->dlen = ret;
+			if ((info->flg & LZ4_FLG_CONTENT_CHECKSUM) != 0)
+				xxh32_update(&info->chash,
+					     info->buf + info->hist, ret);
+			info->cpos += need;
+			info->state = LZ4_STATE_BLOCK_HDR;
+			return 0;
+		default:
+			return -RPROC_EINVAL;
+		}
+	}
+
+more:
+	*noffset = info->cpos;
+	*nlen = need;
+	return 1;
+}
+
+/*
+ * Serve the active request with the decompressed data. Returns 1 once the
+ * request is complete, 0 if the next block is needed, or a negative value
+ * on failure.
+ */
+static int lz4_serve(struct lz4_info *info)
+{
+	const unsigned char *src;
+	size_t need, n;
+	int ret;
+
+	if (!info->req_active || info->rdone == info->rlen)
+		return 1;
+
+	need = info->roff + info->rdone;
+	if (need + info->hist < info->dpos) {
+		/* Data already dropped, decompress again from the start */
+		metal_log(METAL_LOG_DEBUG,
+			  "lz4: restart for offset 0x%lx\r\n", need);
+		info->state = LZ4_STATE_FRAME_HDR;
+		info->cpos = 0;
+		info->hist = 0;
+		info->dpos = 0;
+		info->dlen = 0;
+		return 0;
+	}
+	if (need >= info->dpos + info->dlen)
+		return 0;
+
+	n = metal_min(info->roff + info->rlen, info->dpos + info->dlen) - need;
+	src = info->buf + info->hist + need - info->dpos;
+	if (info->rpa == RPROC_LOAD_ANYADDR) {
+		memcpy(info->local + info->rdone, src, n);
+	} else {
+		ret = metal_io_block_write(info->rio,
+					   metal_io_phys_to_offset(info->rio,
+								   info->rpa +
+								   info->rdone),
+					   src, n);
+		if (ret != (int)n)
+			return -RPROC_EINVAL;
+	}
+	info->rdone += n;
+
+	return info->rdone == info->rlen;
+}
+
+static int lz4_set_request(struct lz4_info *info, size_t offset, size_t len,
+			   metal_phys_addr_t pa, struct metal_io_region *io)
+{
+	if (pa == RPROC_LOAD_ANYADDR && len > info->local_size) {
+		if (info->local)
+			metal_free_memory(info->local);
+		info->local_size = 0;
+		info->local = metal_allocate_memory(len);
+		if (!info->local)
+			return -RPROC_ENOMEM;
+		info->local_size = len;
+	}
+	info->roff = offset;
+	info->rlen = len;
+	info->rdone = 0;
+	info->rpa = pa;
+	info->rio = io;
+	info->req_active = 1;
+
+	return 1;
+}
+
+/*
+ * Pass the served request to the ELF loader and get its next request.
+ * Returns 1 if there is a new request, 0 if the ELF loader does not need
+ * more data in this phase, or a negative value on failure.
+ */
+static int lz4_next_request(struct remoteproc *rproc, struct lz4_info *info)
+{
+	const void *data = NULL;
+	metal_phys_addr_t da, pa;
+	struct metal_io_region *io;
+	size_t noffset = 0, nlen = 0, nmemsize = 0;
+	unsigned char padding = 0;
+	int ret;
+
+	if (info->req_active && info->rpa == RPROC_LOAD_ANYADDR)
+		data = info->local;
+	info->req_active = 0;
+
+	if (info->phase == LZ4_PHASE_HEADER) {
+		if (info->elf_state == ELF_STATE_INIT &&
+		    elf_identify(data, info->rlen) != 0) {
+			metal_log(METAL_LOG_ERROR,
+				  "lz4: compressed image is not an ELF\r\n");
+			return -RPROC_EINVAL;
+		}
+		ret = elf_load_header(data, info->roff, info->rlen,
+				      &info->elf_info, info->elf_state,
+				      &noffset, &nlen);
+		if (ret < 0)
+			return ret;
+		info->elf_state = ret;
+		if ((ret & RPROC_LOADER_READY_TO_LOAD) != 0) {
+			/*
+			 * The section headers are usually at the end of the
+			 * image, get them after the segments
+			 */
+			info->phase = LZ4_PHASE_DATA;
+			return 0;
+		}
+		return lz4_set_request(info, noffset, nlen,
+				       RPROC_LOAD_ANYADDR, NULL);
+	}
+
+	da = RPROC_LOAD_ANYADDR;
+	ret = elf_load(rproc, data, info->roff, info->rlen, &info->elf_info,
+		       info->elf_state, &da, &noffset, &nlen, &padding,
+		       &nmemsize);
+	if (ret < 0)
+		return ret;
+	info->elf_state = ret;
+	if (da != RPROC_LOAD_ANYADDR) {
+		/* Decompress straight to the target memory */
+		pa = METAL_BAD_PHYS;
+		io = NULL;
+		(void)remoteproc_mmap(rproc, &pa, &da, nmemsize, 0, &io);
+		if (pa == METAL_BAD_PHYS || !io) {
+			metal_log(METAL_LOG_ERROR,
+				  "lz4: no mapping for 0x%llx\r\n", da);
+			return -RPROC_EINVAL;
+		}
+		if (nmemsize > nlen) {
+			ret = remoteproc_fill(rproc, pa + nlen, io, padding,
+					      nmemsize - nlen);
+			if (ret < 0)
+				return ret;
+		}
+		return lz4_set_request(info, noffset, nlen, pa, io);
+	} else if (nlen != 0) {
+		return lz4_set_request(info, noffset, nlen,
+				       RPROC_LOAD_ANYADDR, NULL);
+	}
+
+	return 0;
+}
+
+/*
+ * Serve the ELF loader requests until it does not need more data in this
+ * phase, returns 0, or until more compressed data is needed at
+ * noffset/nlen, returns 1. Returns a negative value on failure.
+ */
+static int lz4_run(struct remoteproc *rproc, struct lz4_info *info,
+		   const void *img_data, size_t offset, size_t len,
+		   size_t *noffset, size_t *nlen)
+{
+	int ret;
+
+	while (1) {
+		ret = lz4_serve(info);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			ret = lz4_next_request(rproc, info);
+			if (ret <= 0)
+				return ret;
+			continue;
+		}
+		ret = lz4_next_block(info, img_data, offset, len,
+				     noffset, nlen);
+		if (ret != 0)
+			return ret;
+	}
+}
+
+/*
+ * Decompress the rest of the frame once the ELF loader is done, to check
+ * the content checksum. Returns 0 once checked, 1 if more compressed data
+ * is needed at noffset/nlen, or a negative value on failure.
+ */
+static int lz4_check_content(struct lz4_info *info,
+			     const void *img_data, size_t offset, size_t len,
+			     size_t *noffset, size_t *nlen)
+{
+	int ret;
+
+	while (info->state != LZ4_STATE_END) {
+		ret = lz4_next_block(info, img_data, offset, len,
+				     noffset, nlen);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int lz4_identify(const void *img_data, size_t len)
+{
+	if (len < 4 || !img_data)
+		return -RPROC_EINVAL;
+	if (lz4_read_le32(img_data) != LZ4_FRAME_MAGIC)
+		return -RPROC_EINVAL;
+
+	return 0;
+}
+
+static int lz4_load_header(const void *img_data, size_t offset, size_t len,
+			   void **img_info, int last_load_state,
+			   size_t *noffset, size_t *nlen)
+{
+	struct lz4_info *info;
+	int ret;
+
+	(void)last_load_state;
+	metal_assert(noffset);
+	metal_assert(nlen);
+	if (!*img_info) {
+		info = metal_allocate_memory(sizeof(*info));
+		if (!info)
+			return -RPROC_ENOMEM;
+		memset(info, 0, sizeof(*info));
+		info->state = LZ4_STATE_FRAME_HDR;
+		info->elf_state = ELF_STATE_INIT;
+		*img_info = info;
+		/* Start with the ELF identification */
+		ret = lz4_set_request(info, 0, EI_NIDENT, RPROC_LOAD_ANYADDR,
+				      NULL);
+		if (ret < 0)
+			return ret;
+	}
+	info = *img_info;
+	if (info->phase != LZ4_PHASE_HEADER)
+		return -RPROC_EINVAL;
+
+	*nlen = 0;
+	ret = lz4_run(NULL, info, img_data, offset, len, noffset, nlen);
+	if (ret < 0)
+		return ret;
+
+	return info->elf_state;
+}
+
+static int lz4_load_data(struct remoteproc *rproc,
+			 const void *img_data, size_t offset, size_t len,
+			 void **img_info, int last_load_state,
+			 metal_phys_addr_t *da,
+			 size_t *noffset, size_t *nlen,
+			 unsigned char *padding, size_t *nmemsize)
+{
+	struct lz4_info *info = *img_info;
+	int ret;
+
+	metal_assert(da);
+	metal_assert(noffset);
+	metal_assert(nlen);
+	*da = RPROC_LOAD_ANYADDR;
+	if (!info || info->phase == LZ4_PHASE_HEADER) {
+		ret = lz4_load_header(img_data, offset, len, img_info,
+				      last_load_state, noffset, nlen);
+		if (ret < 0 || (ret & RPROC_LOADER_READY_TO_LOAD) == 0)
+			return ret;
+		info = *img_info;
+	}
+	/* The segments are decompressed to the target memory by the loader */
+	if (padding)
+		*padding = 0;
+	if (nmemsize)
+		*nmemsize = 0;
+
+	*nlen = 0;
+	if (info->phase != LZ4_PHASE_CHECK) {
+		ret = lz4_run(rproc, info, img_data, offset, len, noffset,
+			      nlen);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			/*
+			 * More compressed data is needed, keep the ready to
+			 * load state while a segment is not complete so that
+			 * a truncated image is an error
+			 */
+			if (info->req_active &&
+			    info->rpa != RPROC_LOAD_ANYADDR)
+				return (info->elf_state &
+					~RPROC_LOADER_MASK) |
+				       RPROC_LOADER_READY_TO_LOAD;
+			return info->elf_state;
+		}
+		if ((info->elf_state & RPROC_LOADER_LOAD_COMPLETE) == 0 ||
+		    (info->flg & LZ4_FLG_CONTENT_CHECKSUM) == 0)
+			return info->elf_state;
+		info->phase = LZ4_PHASE_CHECK;
+	}
+
+	/* Not complete until the checksum is checked, even if truncated */
+	ret = lz4_check_content(info, img_data, offset, len, noffset, nlen);
+	if (ret < 0)
+		return ret;
+	if (ret > 0)
+		return (info->elf_state & ~RPROC_LOADER_MASK) |
+		       RPROC_LOADER_READY_TO_LOAD;
+
+	return info->elf_state;
+}
+
+static int lz4_locate_rsc_table(void *img_info, metal_phys_addr_t *da,
+				size_t *offset, size_t *size)
+{
+	struct lz4_info *info = img_info;
+
+	if (!info)
+		return -RPROC_EINVAL;
+
+	return elf_locate_rsc_table(info->elf_info, da, offset, size);
+}
+
+static void lz4_release(void *img_info)
+{
+	struct lz4_info *info = img_info;
+
+	if (!info)
+		return;
+	elf_release(info->elf_info);
+	if (info->buf)
+		metal_free_memory(info->buf);
+	if (info->local)
+		metal_free_memory(info->local);
+	metal_free_memory(info);
+}
+
+static metal_phys_addr_t lz4_get_entry(void *img_info)
+{
+	struct lz4_info *info = img_info;
+
+	if (!info)
+		return METAL_BAD_PHYS;
+
+	return elf_get_entry(info->elf_info);
+}
+
+static int lz4_get_load_state(void *img_info)
+{
+	struct lz4_info *info = img_info;
+
+	if (!info)
+		return -RPROC_EINVAL;
+
+	return info->elf_state;
+}
+
+const struct loader_ops lz4_ops = {
+	.load_header = lz4_load_header,
+	.load_data = lz4_load_data,
+	.locate_rsc_table = lz4_locate_rsc_table,
+	.release = lz4_release,
+	.get_entry = lz4_get_entry,
+	.get_load_state = lz4_get_load_state,
+	.features = LOADER_DECOMPRESS,
+};
@@ -11,6 +11,9 @@
 #include <metal/log.h>
 #include <metal/utilities.h>
 #include <openamp/elf_loader.h>
+#ifdef WITH_LZ4_LOADER
+#include <openamp/lz4_loader.h>
+#endif
 #include <openamp/remoteproc.h>
 #include <openamp/remoteproc_loader.h>
 #include <openamp/remoteproc_virtio.h>
@@ -27,6 +30,10 @@ remoteproc_check_fw_format(const void *img_data, size_t img_len)
 		return NULL;
 	else if (elf_identify(img_data, img_len) == 0)
 		return &elf_ops;
+#ifdef WITH_LZ4_LOADER
+	else if (lz4_identify(img_data, img_len) == 0)
+		return &lz4_ops;
+#endif
 	else
 		return NULL;
 }
@@ -100,9 +107,30 @@ remoteproc_patoda(struct remoteproc_mem *mem, metal_phys_addr_t pa)
 	return da;
 }
 
+/* Get image data to local memory, from the image itself when it is mapped */
+static int remoteproc_load_local(void *store,
+				 const struct image_store_ops *store_ops,
+				 const void *img_base, size_t img_len,
+				 size_t offset, size_t len,
+				 const void **img_data)
+{
+	if (!img_base)
+		return store_ops->load(store, offset, len, img_data,
+				       RPROC_LOAD_ANYADDR, NULL, 1);
+
+	if (offset >= img_len)
+		return -RPROC_EINVAL;
+	if (len > img_len - offset)
+		len = img_len - offset;
+	*img_data = (const char *)img_base + offset;
+
+	return (int)len;
+}
+
 static void *remoteproc_get_rsc_table(struct remoteproc *rproc,
 				      void *store,
 				      const struct image_store_ops *store_ops,
+				      const void *img_base, size_t img_len,
 				      size_t offset,
 				      size_t len)
 {
@@ -117,8 +145,8 @@ static void *remoteproc_get_rsc_table(struct remoteproc *rproc,
 	if (!rsc_table)
 		return NULL;
 
-	ret = store_ops->load(store, offset, len, &img_data, RPROC_LOAD_ANYADDR,
-			      NULL, 1);
+	ret = remoteproc_load_local(store, store_ops, img_base, img_len,
+				    offset, len, &img_data);
 	if (ret < 0 || ret < (int)len || !img_data) {
 		metal_log(METAL_LOG_ERROR,
 			  "get rsc failed: 0x%llx, 0x%llx\r\n", offset, len);
@@ -137,6 +165,295 @@ error:
 	return NULL;
 }
 
+static int remoteproc_parse_rsc_table(struct remoteproc *rproc,
+				      struct resource_table *rsc_table,
+				      size_t rsc_size);
+
+/*
+ * Copy the resource table from the mapped image straight to the target
+ * memory and parse it there, or only parse it if img_base is NULL as it has
+ * already been loaded. Returns -RPROC_EAGAIN if the table cannot be mapped,
+ * so that the caller can fall back to a local copy.
+ */
+static int remoteproc_map_rsc_table(struct remoteproc *rproc,
+				    const void *img_base, size_t img_len,
+				    metal_phys_addr_t da, size_t offset,
+				    size_t len, void **rsc_table,
+				    metal_phys_addr_t *pa,
+				    struct metal_io_region **io)
+{
+	metal_phys_addr_t lpa = METAL_BAD_PHYS;
+	struct metal_io_region *lio = NULL;
+	void *va;
+	int ret;
+
+	if (img_base && (offset >= img_len || len > img_len - offset))
+		return -RPROC_EAGAIN;
+	va = remoteproc_mmap(rproc, &lpa, &da, len, 0, &lio);
+	if (!va || !lio)
+		return -RPROC_EAGAIN;
+	if (img_base) {
+		ret = metal_io_block_write(lio,
+					   metal_io_virt_to_offset(lio, va),
+					   (const char *)img_base + offset,
+					   len);
+		if (ret != (int)len)
+			return -RPROC_EAGAIN;
+	}
+
+	ret = remoteproc_parse_rsc_table(rproc, va, len);
+	if (ret < 0) {
+		metal_log(METAL_LOG_ERROR,
+			  "load: failed to parse rsc table %d\r\n", ret);
+		return ret;
+	}
+	*rsc_table = va;
+	*pa = lpa;
+	*io = lio;
+
+	return 0;
+}
+
+/*
+ * Copy a segment from the mapped image to the target memory in one go,
+ * leaving out the resource table if it has already been parsed in place
+ */
+static int remoteproc_copy_segment(struct metal_io_region *io,
+				   metal_phys_addr_t pa, const char *src,
+				   size_t len, struct metal_io_region *rsc_io,
+				   metal_phys_addr_t rsc_pa, size_t rsc_size)
+{
+	size_t head = len, tail = len;
+	unsigned long offset;
+	int ret;
+
+	if (io == rsc_io && rsc_pa < pa + len && pa < rsc_pa + rsc_size) {
+		head = rsc_pa > pa ? rsc_pa - pa : 0;
+		tail = metal_min((size_t)(rsc_pa + rsc_size - pa), len);
+	}
+
+	offset = metal_io_phys_to_offset(io, pa);
+	if (head > 0) {
+		ret = metal_io_block_write(io, offset, src, head);
+		if (ret != (int)head)
+			return -RPROC_EINVAL;
+	}
+	if (tail < len) {
+		ret = metal_io_block_write(io, offset + tail, src + tail,
+					   len - tail);
+		if (ret != (int)(len - tail))
+			return -RPROC_EINVAL;
+	}
+
+	return 0;
+}
+
+/* Target segment resolved by remoteproc_load_parallel(), not started yet */
+struct remoteproc_load_seg {
+	struct metal_list node;
+	size_t offset;
+	size_t len;
+	metal_phys_addr_t pa;
+	struct metal_io_region *io;
+	/* Base address of the remoteproc memory the segment goes to */
+	metal_phys_addr_t mem_pa;
+	unsigned int max_loads;
+};
+
+/* Non-blocking loads started by remoteproc_load_async(), oldest first */
+struct remoteproc_load_queue {
+	size_t len[RPROC_LOAD_ASYNC_DEPTH];
+	metal_phys_addr_t mem_pa[RPROC_LOAD_ASYNC_DEPTH];
+	unsigned int head;
+	unsigned int count;
+	/* Defer the target loads to the segs list until all are resolved */
+	int defer;
+	struct metal_list segs;
+};
+
+static int remoteproc_load_wait(void *store,
+				const struct image_store_ops *store_ops,
+				struct remoteproc_load_queue *queue)
+{
+	size_t len;
+	int ret;
+
+	len = queue->len[queue->head];
+	queue->head = (queue->head + 1) % RPROC_LOAD_ASYNC_DEPTH;
+	queue->count--;
+
+	ret = store_ops->load_complete(store);
+	if (ret != (int)len) {
+		metal_log(METAL_LOG_ERROR,
+			  "load data failed to complete 0x%lx, %d\r\n",
+			  len, ret);
+		return -RPROC_EINVAL;
+	}
+
+	return 0;
+}
+
+static int remoteproc_load_drain(void *store,
+				 const struct image_store_ops *store_ops,
+				 struct remoteproc_load_queue *queue)
+{
+	int ret = 0;
+
+	/* Wait for all the pending loads, even after a failure */
+	while (queue && queue->count) {
+		if (remoteproc_load_wait(store, store_ops, queue) < 0)
+			ret = -RPROC_EINVAL;
+	}
+
+	return ret;
+}
+
+static int remoteproc_load_start(void *store,
+				 const struct image_store_ops *store_ops,
+				 struct remoteproc_load_queue *queue,
+				 size_t offset, size_t len, metal_phys_addr_t pa,
+				 struct metal_io_region *io,
+				 metal_phys_addr_t mem_pa)
+{
+	const void *img_data;
+	unsigned int tail;
+	int ret;
+
+	/* Keep at most RPROC_LOAD_ASYNC_DEPTH loads in flight */
+	if (queue->count == RPROC_LOAD_ASYNC_DEPTH) {
+		ret = remoteproc_load_wait(store, store_ops, queue);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = store_ops->load(store, offset, len, &img_data, pa, io, 0);
+	if (ret < 0) {
+		metal_log(METAL_LOG_ERROR,
+			  "load data failed to start 0x%lx, 0x%zx, 0x%zx\r\n",
+			  pa, offset, len);
+		return -RPROC_EINVAL;
+	}
+
+	tail = (queue->head + queue->count) % RPROC_LOAD_ASYNC_DEPTH;
+	queue->len[tail] = len;
+	queue->mem_pa[tail] = mem_pa;
+	queue->count++;
+
+	return 0;
+}
+
+static int remoteproc_load_defer(struct remoteproc *rproc,
+				 struct remoteproc_load_queue *queue,
+				 size_t offset, size_t len, metal_phys_addr_t pa,
+				 struct metal_io_region *io)
+{
+	struct remoteproc_load_seg *seg;
+	struct remoteproc_mem *mem;
+	struct remoteproc_mem buf;
+
+	seg = metal_allocate_memory(sizeof(*seg));
+	if (!seg)
+		return -RPROC_ENOMEM;
+	seg->offset = offset;
+	seg->len = len;
+	seg->pa = pa;
+	seg->io = io;
+	seg->mem_pa = METAL_BAD_PHYS;
+	seg->max_loads = 1;
+	memset(&buf, 0, sizeof(buf));
+	mem = remoteproc_get_mem(rproc, NULL, pa, METAL_BAD_PHYS, NULL, len,
+				 &buf);
+	if (mem) {
+		/* mem may be a copy from get_mem(), key it by address */
+		seg->mem_pa = mem->pa;
+		if (mem->max_loads > 1)
+			seg->max_loads = mem->max_loads;
+	}
+	metal_list_add_tail(&queue->segs, &seg->node);
+
+	return 0;
+}
+
+static unsigned int remoteproc_load_busy(struct remoteproc_load_queue *queue,
+					 metal_phys_addr_t mem_pa)
+{
+	unsigned int i, busy = 0;
+
+	for (i = 0; i < queue->count; i++) {
+		if (queue->mem_pa[(queue->head + i) % RPROC_LOAD_ASYNC_DEPTH] ==
+		    mem_pa)
+			busy++;
+	}
+
+	return busy;
+}
+
+static int remoteproc_load_dispatch(void *store,
+				    const struct image_store_ops *store_ops,
+				    struct remoteproc_load_queue *queue)
+{
+	struct remoteproc_load_seg *seg;
+	struct metal_list *node;
+	int ret;
+
+	if (!queue || !queue->defer)
+		return 0;
+
+	while (!metal_list_is_empty(&queue->segs)) {
+		/*
+		 * Start the first segment whose memory can take one more
+		 * load, otherwise wait for the oldest load to free a slot
+		 */
+		seg = NULL;
+		if (queue->count < RPROC_LOAD_ASYNC_DEPTH) {
+			metal_list_for_each(&queue->segs, node) {
+				struct remoteproc_load_seg *tmp;
+
+				tmp = metal_container_of(node,
+							 struct remoteproc_load_seg,
+							 node);
+				if (remoteproc_load_busy(queue, tmp->mem_pa) <
+				    tmp->max_loads) {
+					seg = tmp;
+					break;
+				}
+			}
+		}
+		if (!seg) {
+			ret = remoteproc_load_wait(store, store_ops, queue);
+			if (ret < 0)
+				return ret;
+			continue;
+		}
+		metal_list_del(&seg->node);
+		ret = remoteproc_load_start(store, store_ops, queue,
+					    seg->offset, seg->len, seg->pa,
+					    seg->io, seg->mem_pa);
+		metal_free_memory(seg);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void remoteproc_load_discard(struct remoteproc_load_queue *queue)
+{
+	struct remoteproc_load_seg *seg;
+	struct metal_list *node;
+
+	if (!queue || !queue->defer)
+		return;
+
+	while (!metal_list_is_empty(&queue->segs)) {
+		node = queue->segs.next;
+		seg = metal_container_of(node, struct remoteproc_load_seg,
+					 node);
+		metal_list_del(node);
+		metal_free_memory(seg);
+	}
+}
+
 static int remoteproc_parse_rsc_table(struct remoteproc *rproc,
 				      struct resource_table *rsc_table,
 				      size_t rsc_size)
@@ -315,6 +632,8 @@ void remoteproc_init_mem(struct remoteproc_mem *mem, const char *name,
 	mem->da = da;
 	mem->io = io;
 	mem->size = size;
+	mem->max_loads = 1;
+	mem->fill = RPROC_MEM_FILL_IO;
 }
 
 void remoteproc_add_mem(struct remoteproc *rproc, struct remoteproc_mem *mem)
@@ -441,9 +760,179 @@ void *remoteproc_mmap(struct remoteproc *rproc,
 	return va;
 }
 
-int remoteproc_load(struct remoteproc *rproc, const char *path,
-		    void *store, const struct image_store_ops *store_ops,
-		    void **img_info)
+/* Non-zero if the image is not loaded at its link addresses */
+static int remoteproc_relocated(struct remoteproc *rproc)
+{
+	return rproc->reloc.ro_offset != 0 || rproc->reloc.rw_offset != 0;
+}
+
+/* Hash of the target memory of a segment, 0 if it cannot be read */
+static uint32_t remoteproc_hash_target(struct metal_io_region *io,
+				       metal_phys_addr_t pa, size_t len)
+{
+	void *va;
+
+	va = metal_io_phys_to_virt(io, pa);
+	if (!va || !metal_io_phys_to_virt(io, pa + len - 1))
+		return 0;
+
+	return fnv1a_hash32(FNV1A_HASH32_INIT, va, len);
+}
+
+/*
+ * Record a target segment in the load cache, returns 1 if the segment table
+ * matches the previous load of the same image up to this segment, and the
+ * segment is read-only and its target memory still as loaded
+ */
+static int remoteproc_cache_segment(struct remoteproc_load_cache *cache,
+				    unsigned int idx, int *hit,
+				    size_t offset, size_t len,
+				    metal_phys_addr_t pa,
+				    struct metal_io_region *io, int read_only)
+{
+	struct remoteproc_load_cache_seg *seg;
+
+	if (idx >= cache->max_segs)
+		return 0;
+
+	seg = &cache->segs[idx];
+	if (idx >= cache->num_segs || seg->pa != pa ||
+	    seg->offset != offset || seg->len != len)
+		*hit = 0;
+	if (*hit && read_only && seg->hash &&
+	    remoteproc_hash_target(io, pa, len) == seg->hash)
+		return 1;
+
+	/* Hashed once loaded, the writable segments are never skipped */
+	seg->pa = pa;
+	seg->offset = offset;
+	seg->len = len;
+	seg->io = read_only ? io : NULL;
+	seg->hash = 0;
+
+	return 0;
+}
+
+/* Trust the recorded segments once the load is complete */
+static void remoteproc_cache_commit(struct remoteproc_load_cache *cache,
+				    unsigned int num_segs,
+				    uint32_t image_hash)
+{
+	struct remoteproc_load_cache_seg *seg;
+	unsigned int i;
+
+	if (num_segs > cache->max_segs)
+		return;
+
+	for (i = 0; i < num_segs; i++) {
+		seg = &cache->segs[i];
+		if (seg->io && !seg->hash)
+			seg->hash = remoteproc_hash_target(seg->io, seg->pa,
+							   seg->len);
+	}
+	cache->image_hash = image_hash;
+	cache->num_segs = num_segs;
+	cache->valid = 1;
+}
+
+/*
+ * Check a target segment against the delta, returns 1 if the segment is
+ * unchanged or already updated, 0 if it has to be loaded. The delta entry
+ * of the segment, if any, is returned in dseg.
+ */
+static int remoteproc_delta_segment(const struct remoteproc_load_delta *delta,
+				    metal_phys_addr_t da, size_t len,
+				    metal_phys_addr_t pa,
+				    struct metal_io_region *io, int read_only,
+				    const struct remoteproc_delta_seg **dseg)
+{
+	const struct remoteproc_delta_seg *seg = NULL;
+	unsigned int i;
+	uint32_t hash;
+
+	for (i = 0; i < delta->num_segs; i++) {
+		if (delta->segs[i].da == da && delta->segs[i].len == len) {
+			seg = &delta->segs[i];
+			break;
+		}
+	}
+	*dseg = seg;
+	/* A writable segment was changed by the run of the base image */
+	if (!read_only)
+		return 0;
+	if (!seg)
+		return 1;
+
+	hash = remoteproc_hash_target(io, pa, len);
+	if (!hash) {
+		metal_log(METAL_LOG_ERROR,
+			  "load delta: 0x%lx not mapped\r\n", pa);
+		return -RPROC_EINVAL;
+	}
+	if (hash == seg->hash)
+		return 1;
+	if (seg->base_hash && hash != seg->base_hash) {
+		metal_log(METAL_LOG_ERROR,
+			  "load delta: 0x%lx does not match the base\r\n", pa);
+		return -RPROC_EINVAL;
+	}
+
+	return 0;
+}
+
+int remoteproc_fill(struct remoteproc *rproc, metal_phys_addr_t pa,
+		    struct metal_io_region *io, unsigned char value,
+		    size_t size)
+{
+	struct remoteproc_mem *mem;
+	struct remoteproc_mem buf;
+	unsigned int fill = RPROC_MEM_FILL_IO;
+	void *va;
+	int ret;
+
+	if (!rproc || !io)
+		return -RPROC_EINVAL;
+
+	memset(&buf, 0, sizeof(buf));
+	mem = remoteproc_get_mem(rproc, NULL, pa, METAL_BAD_PHYS, NULL, size,
+				 &buf);
+	if (mem)
+		fill = mem->fill;
+
+	switch (fill) {
+	case RPROC_MEM_FILL_MEMSET:
+		va = metal_io_phys_to_virt(io, pa);
+		if (va) {
+			memset(va, value, size);
+			return 0;
+		}
+		break;
+	case RPROC_MEM_FILL_OPS:
+		if (rproc->ops->fill)
+			return rproc->ops->fill(rproc, pa, io, value, size);
+		break;
+	case RPROC_MEM_FILL_ZEROED:
+		if (value == 0)
+			return 0;
+		break;
+	default:
+		break;
+	}
+
+	ret = metal_io_block_set(io, metal_io_phys_to_offset(io, pa), value,
+				 size);
+	if (ret != (int)size)
+		return -RPROC_EINVAL;
+
+	return 0;
+}
+
+static int remoteproc_load_image(struct remoteproc *rproc, const char *path,
+				 void *store,
+				 const struct image_store_ops *store_ops,
+				 void **img_info,
+				 struct remoteproc_load_queue *queue,
+				 const struct remoteproc_load_delta *delta)
 {
 	int ret;
 	const struct loader_ops *loader;
@@ -456,9 +945,18 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 	size_t rsc_size = 0;
 	void *rsc_table = NULL;
 	struct metal_io_region *io = NULL;
-
-	if (!rproc)
-		return -RPROC_ENODEV;
+	const void *img_base = NULL;
+	size_t img_len = 0;
+	void *rsc_va = NULL;
+	metal_phys_addr_t rsc_pa = METAL_BAD_PHYS;
+	struct metal_io_region *rsc_io = NULL;
+	struct remoteproc_load_cache *cache;
+	uint32_t image_hash = FNV1A_HASH32_INIT;
+	unsigned int nseg = 0;
+	int cache_hit = 0;
+	const struct remoteproc_delta_seg *dseg;
+	unsigned int delta_segs = 0;
+	int hdrs_mapped;
 
 	metal_mutex_acquire(&rproc->lock);
 	metal_log(METAL_LOG_DEBUG, "%s: check remoteproc status\r\n", __func__);
@@ -490,6 +988,11 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 	}
 	len = ret;
 	metal_assert(img_data);
+	if ((store_ops->features & SUPPORT_MAPPED) != 0) {
+		/* The whole image is addressable, parse it in place */
+		img_base = img_data;
+		img_len = len;
+	}
 
 	/* Check executable format to select a parser */
 	loader = rproc->loader;
@@ -504,12 +1007,60 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		}
 		rproc->loader = loader;
 	}
+	if (delta && (loader->features & LOADER_DECOMPRESS) != 0) {
+		metal_log(METAL_LOG_ERROR,
+			  "load failure: no delta load of compressed image.\r\n");
+		ret = -RPROC_EINVAL;
+		goto error1;
+	}
+	if (delta && remoteproc_relocated(rproc)) {
+		metal_log(METAL_LOG_ERROR,
+			  "load failure: no delta load of relocated image.\r\n");
+		ret = -RPROC_EINVAL;
+		goto error1;
+	}
+
+	/* The cache is only valid again once the load is complete */
+	cache = rproc->load_cache;
+	if (cache) {
+		cache_hit = cache->valid;
+		cache->valid = 0;
+		/*
+		 * The delta load leaves the base segments out of the cache,
+		 * intact segments of a relocated image would be relocated
+		 * again, and the image is only identified if all of it is hashed
+		 */
+		if (delta || remoteproc_relocated(rproc) || !img_base) {
+			cache_hit = 0;
+			cache = NULL;
+		}
+	}
 
 	/* Load executable headers */
 	metal_log(METAL_LOG_DEBUG, "%s: loading headers\r\n", __func__);
 	offset = 0;
 	last_load_state = RPROC_LOADER_NOT_READY;
-	while (1) {
+	hdrs_mapped = 0;
+	if (cache)
+		image_hash = fnv1a_hash32(image_hash, img_base, img_len);
+	/*
+	 * The whole image is resident, parse the headers in one go. The image
+	 * information then points into the image, so not if it is returned to
+	 * the caller, as the image is closed at the end of the load.
+	 */
+	if (img_base && loader->load_header_mapped && !img_info) {
+		ret = loader->load_header_mapped(img_base, img_len,
+						 &limg_info);
+		if (ret >= 0) {
+			last_load_state = ret;
+			hdrs_mapped = 1;
+		} else if (ret != -RPROC_EAGAIN) {
+			metal_log(METAL_LOG_ERROR,
+				  "load mapped headers failed %d.\r\n", ret);
+			goto error2;
+		}
+	}
+	while (!hdrs_mapped) {
 		ret = loader->load_header(img_data, offset, len,
 					  &limg_info, last_load_state,
 					  &noffset, &nlen);
@@ -527,7 +1078,8 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 			if (nlen == 0)
 				break;
 			else if ((noffset > (offset + len)) &&
-				 (store_ops->features & SUPPORT_SEEK) == 0) {
+				 (store_ops->features &
+				  (SUPPORT_SEEK | SUPPORT_MAPPED)) == 0) {
 				/* Required data is not continued, however
 				 * seek is not supported, stop to load
 				 * headers such as ELF section headers which
@@ -540,10 +1092,9 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		}
 		/* Continue to load headers image data */
 		img_data = NULL;
-		ret = store_ops->load(store, noffset, nlen,
-				      &img_data,
-				      RPROC_LOAD_ANYADDR,
-				      NULL, 1);
+		ret = remoteproc_load_local(store, store_ops, img_base,
+					    img_len, noffset, nlen,
+					    &img_data);
 		if (ret < (int)nlen) {
 			metal_log(METAL_LOG_ERROR,
 				  "load image data failed 0x%x,%d\r\n",
@@ -553,11 +1104,33 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		offset = noffset;
 		len = nlen;
 	}
-	ret = loader->locate_rsc_table(limg_info, &rsc_da, &offset, &rsc_size);
+	if (cache_hit && cache->image_hash != image_hash)
+		cache_hit = 0;
+
+	/*
+	 * The resource table of a compressed image is only read once loaded,
+	 * and its address in a relocated image once the loader placed it
+	 */
+	ret = -RPROC_ERR_LOADER_STATE;
+	if ((loader->features & LOADER_DECOMPRESS) == 0 &&
+	    !remoteproc_relocated(rproc))
+		ret = loader->locate_rsc_table(limg_info, &rsc_da, &offset,
+					       &rsc_size);
 	if (ret == 0 && rsc_size > 0) {
 		/* parse resource table */
-		rsc_table = remoteproc_get_rsc_table(rproc, store, store_ops,
-						     offset, rsc_size);
+		ret = -RPROC_EAGAIN;
+		if (img_base && !queue && !delta) {
+			/* The segment copies will go around it */
+			ret = remoteproc_map_rsc_table(rproc, img_base, img_len,
+						       rsc_da, offset,
+						       rsc_size, &rsc_va,
+						       &rsc_pa, &rsc_io);
+		}
+		if (ret == -RPROC_EAGAIN)
+			rsc_table = remoteproc_get_rsc_table(rproc, store,
+							     store_ops,
+							     img_base, img_len,
+							     offset, rsc_size);
 	}
 
 	/* load executable data */
@@ -573,6 +1146,15 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		nlen = 0;
 		nmemsize = 0;
 		noffset = 0;
+		if ((last_load_state & RPROC_LOADER_POST_DATA_LOAD) != 0) {
+			/* The post-load step, e.g. relocation, needs the data */
+			ret = remoteproc_load_dispatch(store, store_ops, queue);
+			if (ret >= 0)
+				ret = remoteproc_load_drain(store, store_ops,
+							    queue);
+			if (ret < 0)
+				goto error3;
+		}
 		ret = loader->load_data(rproc, img_data, offset, len,
 					&limg_info, last_load_state, &da,
 					&noffset, &nlen, &padding, &nmemsize);
@@ -600,7 +1182,75 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 				ret = -RPROC_EINVAL;
 				goto error3;
 			}
-			if (nlen > 0) {
+			dseg = NULL;
+			if (nlen > 0 && delta) {
+				ret = remoteproc_delta_segment(delta, da, nlen,
+							       pa, io,
+							       last_load_state &
+							       RPROC_LOADER_DATA_RO,
+							       &dseg);
+				if (ret < 0)
+					goto error3;
+				if (dseg)
+					delta_segs++;
+				/* Only check the segments loaded now */
+				if (ret)
+					dseg = NULL;
+			}
+			if (nlen > 0 && delta && ret) {
+				/* Unchanged from the resident base image */
+				metal_log(METAL_LOG_DEBUG,
+					  "load data: 0x%lx unchanged\r\n", pa);
+			} else if (nlen > 0 && cache &&
+			    remoteproc_cache_segment(cache, nseg++, &cache_hit,
+						     noffset, nlen, pa, io,
+						     last_load_state &
+						     RPROC_LOADER_DATA_RO)) {
+				/* Read-only, still as the last load left it */
+				metal_log(METAL_LOG_DEBUG,
+					  "load data: 0x%lx cached\r\n", pa);
+			} else if (nlen > 0 && queue && queue->defer) {
+				/* Only record the segment, all are started
+				 * together once the image is parsed
+				 */
+				ret = remoteproc_load_defer(rproc, queue,
+							    noffset, nlen,
+							    pa, io);
+				if (ret < 0)
+					goto error3;
+			} else if (nlen > 0 && queue) {
+				/*
+				 * Start the load and go on with the next
+				 * segment while the store copies this one
+				 */
+				ret = remoteproc_load_start(store, store_ops,
+							    queue, noffset,
+							    nlen, pa, io,
+							    METAL_BAD_PHYS);
+				if (ret < 0)
+					goto error3;
+			} else if (nlen > 0 && img_base) {
+				/* Copy straight from the mapped image */
+				ret = remoteproc_load_local(store, store_ops,
+							    img_base, img_len,
+							    noffset, nlen,
+							    &img_data);
+				if (ret == (int)nlen)
+					ret = remoteproc_copy_segment(io, pa,
+								      img_data,
+								      nlen,
+								      rsc_io,
+								      rsc_pa,
+								      rsc_size);
+				else
+					ret = -RPROC_EINVAL;
+				if (ret < 0) {
+					metal_log(METAL_LOG_ERROR,
+						  "load data failed 0x%lx, 0x%zx, 0x%zx\r\n",
+						  pa, noffset, nlen);
+					goto error3;
+				}
+			} else if (nlen > 0) {
 				ret = store_ops->load(store, noffset, nlen,
 						      &img_data, pa, io, 1);
 				if (ret != (int)nlen) {
@@ -611,19 +1261,34 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 					goto error3;
 				}
 			}
+			if (dseg &&
+			    remoteproc_hash_target(io, pa, nlen) != dseg->hash) {
+				metal_log(METAL_LOG_ERROR,
+					  "load delta: 0x%lx hash mismatch\r\n",
+					  pa);
+				ret = -RPROC_EINVAL;
+				goto error3;
+			}
 			if (nmemsize > nlen) {
-				size_t tmpoffset;
-
-				tmpoffset = metal_io_phys_to_offset(io,
-								    pa + nlen);
-				metal_io_block_set(io, tmpoffset,
-						   padding, (nmemsize - nlen));
+				ret = remoteproc_fill(rproc, pa + nlen, io,
+						      padding,
+						      nmemsize - nlen);
+				if (ret < 0) {
+					metal_log(METAL_LOG_ERROR,
+						  "load fill failed 0x%lx, 0x%zx\r\n",
+						  pa + nlen, nmemsize - nlen);
+					goto error3;
+				}
 			}
 		} else if (nlen != 0) {
-			ret = store_ops->load(store, noffset, nlen,
-					      &img_data,
-					      RPROC_LOAD_ANYADDR,
-					      NULL, 1);
+			/* The data is needed now, let the pending loads end */
+			ret = remoteproc_load_drain(store, store_ops, queue);
+			if (ret < 0)
+				goto error3;
+			ret = remoteproc_load_local(store, store_ops,
+						    img_base, img_len,
+						    noffset, nlen,
+						    &img_data);
 			if (ret < (int)nlen) {
 				if ((last_load_state &
 				    RPROC_LOADER_POST_DATA_LOAD) != 0) {
@@ -644,18 +1309,63 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		}
 	}
 
+	ret = remoteproc_load_dispatch(store, store_ops, queue);
+	if (ret < 0)
+		goto error3;
+	ret = remoteproc_load_drain(store, store_ops, queue);
+	if (ret < 0)
+		goto error3;
+
+	if (delta && delta_segs != delta->num_segs) {
+		metal_log(METAL_LOG_ERROR,
+			  "load delta: %u of %u segments in the image\r\n",
+			  delta_segs, delta->num_segs);
+		ret = -RPROC_EINVAL;
+		goto error3;
+	}
+
 	if (rsc_size == 0) {
 		ret = loader->locate_rsc_table(limg_info, &rsc_da,
 					       &offset, &rsc_size);
 		if (ret == 0 && rsc_size > 0) {
 			/* parse resource table */
-			rsc_table = remoteproc_get_rsc_table(rproc, store,
-							     store_ops,
-							     offset,
-							     rsc_size);
+			ret = -RPROC_EAGAIN;
+			if ((loader->features & LOADER_DECOMPRESS) != 0) {
+				/* Already loaded, parse it in place */
+				ret = remoteproc_map_rsc_table(rproc, NULL, 0,
+							       rsc_da, offset,
+							       rsc_size,
+							       &rsc_va, &rsc_pa,
+							       &rsc_io);
+				if (ret == -RPROC_EAGAIN)
+					metal_log(METAL_LOG_WARNING,
+						  "load: not able to map rsc table.\r\n");
+			} else if (img_base && !delta) {
+				ret = remoteproc_map_rsc_table(rproc, img_base,
+							       img_len, rsc_da,
+							       offset, rsc_size,
+							       &rsc_va, &rsc_pa,
+							       &rsc_io);
+			}
+			if (ret == -RPROC_EAGAIN &&
+			    (loader->features & LOADER_DECOMPRESS) == 0)
+				rsc_table = remoteproc_get_rsc_table(rproc,
+								     store,
+								     store_ops,
+								     img_base,
+								     img_len,
+								     offset,
+								     rsc_size);
 		}
 	}
 
+	/* Resource table parsed in place in the target memory */
+	if (rsc_va) {
+		rproc->rsc_table = rsc_va;
+		rproc->rsc_len = rsc_size;
+		rproc->rsc_io = rsc_io;
+	}
+
 	/* Update resource table */
 	if (rsc_table) {
 		void *rsc_table_cp = rsc_table;
@@ -687,6 +1397,9 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 		rsc_table = NULL;
 	}
 
+	if (cache)
+		remoteproc_cache_commit(cache, nseg, image_hash);
+
 	metal_log(METAL_LOG_DEBUG, "%s: successfully load firmware\r\n",
 		  __func__);
 	/* get entry point from the firmware */
@@ -702,6 +1415,8 @@ int remoteproc_load(struct remoteproc *rproc, const char *path,
 	return 0;
 
 error3:
+	(void)remoteproc_load_drain(store, store_ops, queue);
+	remoteproc_load_discard(queue);
 	if (rsc_table)
 		metal_free_memory(rsc_table);
 error2:
@@ -712,6 +1427,109 @@ error1:
 	return ret;
 }
 
+void remoteproc_init_load_cache(struct remoteproc_load_cache *cache,
+				struct remoteproc_load_cache_seg *segs,
+				unsigned int max_segs)
+{
+	if (!cache)
+		return;
+	memset(cache, 0, sizeof(*cache));
+	cache->segs = segs;
+	cache->max_segs = segs ? max_segs : 0;
+}
+
+int remoteproc_set_load_cache(struct remoteproc *rproc,
+			      struct remoteproc_load_cache *cache)
+{
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	metal_mutex_acquire(&rproc->lock);
+	rproc->load_cache = cache;
+	metal_mutex_release(&rproc->lock);
+
+	return 0;
+}
+
+int remoteproc_set_reloc(struct remoteproc *rproc,
+			 const struct remoteproc_reloc *reloc)
+{
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	metal_mutex_acquire(&rproc->lock);
+	if (reloc)
+		rproc->reloc = *reloc;
+	else
+		memset(&rproc->reloc, 0, sizeof(rproc->reloc));
+	metal_mutex_release(&rproc->lock);
+
+	return 0;
+}
+
+int remoteproc_load(struct remoteproc *rproc, const char *path,
+		    void *store, const struct image_store_ops *store_ops,
+		    void **img_info)
+{
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	return remoteproc_load_image(rproc, path, store, store_ops, img_info,
+				     NULL, NULL);
+}
+
+int remoteproc_load_delta(struct remoteproc *rproc, const char *path,
+			  void *store, const struct image_store_ops *store_ops,
+			  const struct remoteproc_load_delta *delta,
+			  void **img_info)
+{
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	if (!delta || (delta->num_segs && !delta->segs))
+		return -RPROC_EINVAL;
+
+	return remoteproc_load_image(rproc, path, store, store_ops, img_info,
+				     NULL, delta);
+}
+
+int remoteproc_load_async(struct remoteproc *rproc, const char *path,
+			  void *store, const struct image_store_ops *store_ops,
+			  void **img_info)
+{
+	struct remoteproc_load_queue queue;
+
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	if (!store_ops || !store_ops->load_complete)
+		return -RPROC_EINVAL;
+
+	memset(&queue, 0, sizeof(queue));
+	return remoteproc_load_image(rproc, path, store, store_ops, img_info,
+				     &queue, NULL);
+}
+
+int remoteproc_load_parallel(struct remoteproc *rproc, const char *path,
+			     void *store,
+			     const struct image_store_ops *store_ops,
+			     void **img_info)
+{
+	struct remoteproc_load_queue queue;
+
+	if (!rproc)
+		return -RPROC_ENODEV;
+
+	if (!store_ops || !store_ops->load_complete)
+		return -RPROC_EINVAL;
+
+	memset(&queue, 0, sizeof(queue));
+	queue.defer = 1;
+	metal_list_init(&queue.segs);
+	return remoteproc_load_image(rproc, path, store, store_ops, img_info,
+				     &queue, NULL);
+}
+
 int remoteproc_load_noblock(struct remoteproc *rproc,
 			    const void *img_data, size_t offset, size_t len,
 			    void **img_info,
@@ -948,6 +1766,8 @@ remoteproc_create_virtio(struct remoteproc *rproc,
 	size_t vdev_rsc_offset;
 	unsigned int notifyid;
 	unsigned int num_vrings, i;
+	unsigned int cache_line;
+	uint32_t features;
 	struct metal_list *node;
 
 #if !VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT)
@@ -998,6 +1818,12 @@ remoteproc_create_virtio(struct remoteproc *rproc,
 	metal_list_add_tail(&rproc->vdevs, &rpvdev->node);
 	num_vrings = vdev_rsc->num_of_vrings;
 
+	/* Features are negotiated at this stage, get the vring layout */
+	if (virtio_get_features(vdev, &features))
+		goto err1;
+	cache_line = (features & VIRTIO_RING_F_CACHE_ALIGNED) ?
+		     VRING_CACHE_LINE_SIZE : 0;
+
 	/* set the notification id for vrings */
 	for (i = 0; i < num_vrings; i++) {
 		struct fw_rsc_vdev_vring *vring_rsc;
@@ -1013,7 +1839,7 @@ remoteproc_create_virtio(struct remoteproc *rproc,
 		da = vring_rsc->da;
 		num_descs = vring_rsc->num;
 		align = vring_rsc->align;
-		size = vring_size(num_descs, align);
+		size = vring_size_cache_aligned(num_descs, align, cache_line);
 		va = remoteproc_mmap(rproc, NULL, &da, size, 0, &io);
 		if (!va)
 			goto err1;
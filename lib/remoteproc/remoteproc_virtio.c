@@ -56,9 +56,20 @@ static int rproc_virtio_create_virtqueue(struct virtio_device *vdev,
 	if (!vring_info->vq)
 		return ERROR_NO_MEM;
 
+	/*
+	 * The features are negotiated at this stage: after DRIVER_OK for the
+	 * device, at vdev creation for the driver.
+	 */
+	if (vdev->features & VIRTIO_RING_F_CACHE_ALIGNED)
+		vring_alloc->cache_line = VRING_CACHE_LINE_SIZE;
+	else
+		vring_alloc->cache_line = 0;
+
 	if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
 		size_t offset = metal_io_virt_to_offset(vring_info->io, vring_alloc->vaddr);
-		size_t size = vring_size(vring_alloc->num_descs, vring_alloc->align);
+		size_t size = vring_size_cache_aligned(vring_alloc->num_descs,
+						       vring_alloc->align,
+						       vring_alloc->cache_line);
 
 		metal_io_block_set(vring_info->io, offset, 0, size);
 	}
@@ -299,6 +310,9 @@ rproc_virtio_create_vdev(unsigned int role, unsigned int notifyid,
 	struct virtio_device *vdev;
 	unsigned int num_vrings = vdev_rsc->num_of_vrings;
 
+	if (!VIRTIO_ROLE_IS_SUPPORTED(role))
+		return NULL;
+
 	rpvdev = metal_allocate_memory(sizeof(*rpvdev));
 	if (!rpvdev)
 		return NULL;
@@ -330,8 +344,16 @@ rproc_virtio_create_vdev(unsigned int role, unsigned int notifyid,
 #if VIRTIO_ENABLED(VIRTIO_DRIVER_SUPPORT)
 	if (role == VIRTIO_DEV_DRIVER) {
 		uint32_t dfeatures = rproc_virtio_get_dfeatures(vdev);
-		/* Assume the virtio driver support all remote features */
-		rproc_virtio_negotiate_features(vdev, dfeatures);
+
+#if defined(VIRTIO_EVENT_IDX_SUPPORT) && !VIRTIO_ENABLED(VIRTIO_EVENT_IDX_SUPPORT)
+		dfeatures &= ~VIRTIO_RING_F_EVENT_IDX;
+#endif
+		/*
+		 * Assume the virtio driver support all remote features. Keep
+		 * the result as the virtqueues depend on the negotiated ring
+		 * features.
+		 */
+		vdev->features = rproc_virtio_negotiate_features(vdev, dfeatures);
 	}
 #endif
 
@@ -370,6 +392,8 @@ int rproc_virtio_init_vring(struct virtio_device *vdev, unsigned int index,
 	vring_info->info.vaddr = va;
 	vring_info->info.num_descs = num_descs;
 	vring_info->info.align = align;
+	/* The layout is set from the negotiated features at vq creation */
+	vring_info->info.cache_line = 0;
 
 	return 0;
 }
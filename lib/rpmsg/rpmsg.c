@@ -203,6 +203,9 @@ void *rpmsg_get_tx_payload_buffer(struct rpmsg_endpoint *ept,
 
 	rdev = ept->rdev;
 
+	if (rdev->ops.get_tx_payload_buffer_from)
+		return rdev->ops.get_tx_payload_buffer_from(rdev, ept->addr,
+							    len, wait);
 	if (rdev->ops.get_tx_payload_buffer)
 		return rdev->ops.get_tx_payload_buffer(rdev, len, wait);
 
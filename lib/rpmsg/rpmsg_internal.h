@@ -28,9 +28,13 @@ extern "C" {
 #define RPMSG_ASSERT(_exp, _msg) metal_assert(_exp)
 #endif
 
+/* Mask to get the rpmsg buffer queue pair from rpmsg_hdr reserved field */
+#define RPMSG_BUF_QPAIR_SHIFT 16
+#define RPMSG_BUF_QPAIR_MASK  (0xFFU << RPMSG_BUF_QPAIR_SHIFT)
+
 /* Mask to get the rpmsg buffer held counter from rpmsg_hdr reserved field */
-#define RPMSG_BUF_HELD_SHIFT 16
-#define RPMSG_BUF_HELD_MASK  (0xFFFFU << RPMSG_BUF_HELD_SHIFT)
+#define RPMSG_BUF_HELD_SHIFT 24
+#define RPMSG_BUF_HELD_MASK  (0xFFU << RPMSG_BUF_HELD_SHIFT)
 
 #define RPMSG_LOCATE_HDR(p) \
 	((struct rpmsg_hdr *)((unsigned char *)(p) - sizeof(struct rpmsg_hdr)))
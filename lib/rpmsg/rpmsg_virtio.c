@@ -17,6 +17,81 @@
 
 #include "rpmsg_internal.h"
 
+#if defined(VQ_INLINE) && VIRTIO_ENABLED(VQ_INLINE)
+#include <openamp/virtqueue_inline.h>
+#define RPMSG_VIRTIO_VQ_INLINE 1
+#else
+#define RPMSG_VIRTIO_VQ_INLINE 0
+#endif
+
+/*
+ * Virtqueue operations of the message hot path, using the inline variants
+ * when built with VQ_INLINE.
+ */
+static inline int rpmsg_virtio_vq_add_buffer(struct virtqueue *vq,
+					     struct virtqueue_buf *buf_list,
+					     int readable, int writable,
+					     void *cookie)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	return virtqueue_add_buffer_inline(vq, buf_list, readable, writable,
+					   cookie);
+#else
+	return virtqueue_add_buffer(vq, buf_list, readable, writable, cookie);
+#endif
+}
+
+static inline int rpmsg_virtio_vq_add_consumed_buffer(struct virtqueue *vq,
+						      uint16_t head_idx,
+						      uint32_t len)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	return virtqueue_add_consumed_buffer_inline(vq, head_idx, len);
+#else
+	return virtqueue_add_consumed_buffer(vq, head_idx, len);
+#endif
+}
+
+static inline void *rpmsg_virtio_vq_get_buffer(struct virtqueue *vq,
+					       uint32_t *len, uint16_t *idx)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	return virtqueue_get_buffer_inline(vq, len, idx);
+#else
+	return virtqueue_get_buffer(vq, len, idx);
+#endif
+}
+
+static inline uint32_t rpmsg_virtio_vq_get_buffer_length(struct virtqueue *vq,
+							 uint16_t idx)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	return virtqueue_get_buffer_length_inline(vq, idx);
+#else
+	return virtqueue_get_buffer_length(vq, idx);
+#endif
+}
+
+static inline void *
+rpmsg_virtio_vq_get_first_avail_buffer(struct virtqueue *vq, uint16_t *avail_idx,
+				       uint32_t *len)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	return virtqueue_get_first_avail_buffer_inline(vq, avail_idx, len);
+#else
+	return virtqueue_get_first_avail_buffer(vq, avail_idx, len);
+#endif
+}
+
+static inline void rpmsg_virtio_vq_kick(struct virtqueue *vq)
+{
+#if RPMSG_VIRTIO_VQ_INLINE
+	virtqueue_kick_inline(vq);
+#else
+	virtqueue_kick(vq);
+#endif
+}
+
 #define RPMSG_NUM_VRINGS                        2
 
 /* Total tick count for 15secs - 1usec tick. */
@@ -32,6 +107,10 @@
 #define RPMSG_BUF_HELD_COUNTER(rp_hdr)          \
 	(((rp_hdr)->reserved & RPMSG_BUF_HELD_MASK) >> RPMSG_BUF_HELD_SHIFT)
 
+/* Maximum value of the buffer held counter */
+#define RPMSG_BUF_HELD_MAX                      \
+	(RPMSG_BUF_HELD_MASK >> RPMSG_BUF_HELD_SHIFT)
+
 /* Increase buffer held counter */
 #define RPMSG_BUF_HELD_INC(rp_hdr)              \
 	((rp_hdr)->reserved += 1 << RPMSG_BUF_HELD_SHIFT)
@@ -41,8 +120,17 @@
 	((rp_hdr)->reserved -= 1 << RPMSG_BUF_HELD_SHIFT)
 
 /* Get the buffer index */
-#define RPMSG_BUF_INDEX(rphdr)                  \
-	((uint16_t)((rp_hdr)->reserved & ~RPMSG_BUF_HELD_MASK))
+#define RPMSG_BUF_INDEX(rp_hdr)                 \
+	((uint16_t)((rp_hdr)->reserved & ~(RPMSG_BUF_HELD_MASK | \
+					   RPMSG_BUF_QPAIR_MASK)))
+
+/* Get the buffer queue pair index */
+#define RPMSG_BUF_QPAIR(rp_hdr)                 \
+	(((rp_hdr)->reserved & RPMSG_BUF_QPAIR_MASK) >> RPMSG_BUF_QPAIR_SHIFT)
+
+/* Build the reserved field from the buffer index and queue pair index */
+#define RPMSG_BUF_RESERVED(idx, qp)             \
+	((uint32_t)(idx) | ((uint32_t)(qp) << RPMSG_BUF_QPAIR_SHIFT))
 
 /**
  * struct vbuff_reclaimer_t - vring buffer recycler
@@ -96,17 +184,84 @@ void rpmsg_virtio_init_shm_pool(struct rpmsg_virtio_shm_pool *shpool,
 	shpool->avail = size;
 }
 
+/**
+ * @internal
+ *
+ * @brief Get the lock protecting the virtqueues of a queue pair.
+ *
+ * With a single queue pair, the RPMsg device lock is used so that the
+ * message path takes no more locks than without queue pairs.
+ *
+ * @param rvdev	Pointer to rpmsg virtio device
+ * @param qp	Pointer to the queue pair
+ *
+ * @return Pointer to the lock
+ */
+static inline metal_mutex_t *
+rpmsg_virtio_qpair_lock(struct rpmsg_virtio_device *rvdev,
+			struct rpmsg_virtio_qpair *qp)
+{
+	return rvdev->num_qpairs > 1 ? &qp->lock : &rvdev->rdev.lock;
+}
+
+/**
+ * @internal
+ *
+ * @brief Get the reclaimer of the unused TX buffers of a queue pair.
+ *
+ * The first queue pair uses the reclaimer of the RPMsg virtio device.
+ *
+ * @param rvdev	Pointer to rpmsg virtio device
+ * @param qp	Pointer to the queue pair
+ *
+ * @return Pointer to the reclaimer list
+ */
+static inline struct metal_list *
+rpmsg_virtio_qpair_reclaimer(struct rpmsg_virtio_device *rvdev,
+			     struct rpmsg_virtio_qpair *qp)
+{
+	return qp == rvdev->qpairs ? &rvdev->reclaimer : &qp->reclaimer;
+}
+
+/**
+ * @internal
+ *
+ * @brief Get the queue pair used to send messages from an address.
+ *
+ * @param rvdev	Pointer to rpmsg virtio device
+ * @param src	Source address of the messages
+ *
+ * @return Pointer to the queue pair
+ */
+static struct rpmsg_virtio_qpair *
+rpmsg_virtio_get_tx_qpair(struct rpmsg_virtio_device *rvdev, uint32_t src)
+{
+	unsigned int i;
+
+	if (rvdev->num_qpairs == 1)
+		return &rvdev->qpairs[0];
+
+	if (rvdev->steer_cb)
+		i = rvdev->steer_cb(&rvdev->rdev, src) % rvdev->num_qpairs;
+	else
+		i = src % rvdev->num_qpairs;
+
+	return &rvdev->qpairs[i];
+}
+
 /**
  * @internal
  *
  * @brief Places the used buffer back on the virtqueue.
  *
  * @param rvdev		Pointer to remote core
+ * @param qp		Queue pair of the buffer
  * @param buffer	Buffer pointer
  * @param len		Buffer length
  * @param idx		Buffer index
  */
 static void rpmsg_virtio_return_buffer(struct rpmsg_virtio_device *rvdev,
+				       struct rpmsg_virtio_qpair *qp,
 				       void *buffer, uint32_t len,
 				       uint16_t idx)
 {
@@ -121,13 +276,13 @@ static void rpmsg_virtio_return_buffer(struct rpmsg_virtio_device *rvdev,
 		/* Initialize buffer node */
 		vqbuf.buf = buffer;
 		vqbuf.len = len;
-		ret = virtqueue_add_buffer(rvdev->rvq, &vqbuf, 0, 1, buffer);
+		ret = rpmsg_virtio_vq_add_buffer(qp->rvq, &vqbuf, 0, 1, buffer);
 		RPMSG_ASSERT(ret == VQUEUE_SUCCESS, "add buffer failed\r\n");
 	}
 
 	if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
 		(void)buffer;
-		ret = virtqueue_add_consumed_buffer(rvdev->rvq, idx, len);
+		ret = rpmsg_virtio_vq_add_consumed_buffer(qp->rvq, idx, len);
 		RPMSG_ASSERT(ret == VQUEUE_SUCCESS, "add consumed buffer failed\r\n");
 	}
 }
@@ -138,6 +293,7 @@ static void rpmsg_virtio_return_buffer(struct rpmsg_virtio_device *rvdev,
  * @brief Places buffer on the virtqueue for consumption by the other side.
  *
  * @param rvdev		Pointer to rpmsg virtio
+ * @param qp		Queue pair of the buffer
  * @param buffer	Buffer pointer
  * @param len		Buffer length
  * @param idx		Buffer index
@@ -145,6 +301,7 @@ static void rpmsg_virtio_return_buffer(struct rpmsg_virtio_device *rvdev,
  * @return Status of function execution
  */
 static int rpmsg_virtio_enqueue_buffer(struct rpmsg_virtio_device *rvdev,
+				       struct rpmsg_virtio_qpair *qp,
 				       void *buffer, uint32_t len,
 				       uint16_t idx)
 {
@@ -157,12 +314,12 @@ static int rpmsg_virtio_enqueue_buffer(struct rpmsg_virtio_device *rvdev,
 		/* Initialize buffer node */
 		vqbuf.buf = buffer;
 		vqbuf.len = len;
-		return virtqueue_add_buffer(rvdev->svq, &vqbuf, 1, 0, buffer);
+		return rpmsg_virtio_vq_add_buffer(qp->svq, &vqbuf, 1, 0, buffer);
 	}
 
 	if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
 		(void)buffer;
-		return virtqueue_add_consumed_buffer(rvdev->svq, idx, len);
+		return rpmsg_virtio_vq_add_consumed_buffer(qp->svq, idx, len);
 	}
 
 	return 0;
@@ -174,12 +331,14 @@ static int rpmsg_virtio_enqueue_buffer(struct rpmsg_virtio_device *rvdev,
  * @brief Provides buffer to transmit messages.
  *
  * @param rvdev	Pointer to rpmsg device
+ * @param qp	Queue pair to get the buffer from
  * @param len	Length of returned buffer
  * @param idx	Buffer index
  *
  * @return Pointer to buffer.
  */
 static void *rpmsg_virtio_get_tx_buffer(struct rpmsg_virtio_device *rvdev,
+					struct rpmsg_virtio_qpair *qp,
 					uint32_t *len, uint16_t *idx)
 {
 	struct metal_list *node;
@@ -187,7 +346,7 @@ static void *rpmsg_virtio_get_tx_buffer(struct rpmsg_virtio_device *rvdev,
 	void *data = NULL;
 
 	/* Try first to recycle a buffer that has been freed without been used */
-	node = metal_list_first(&rvdev->reclaimer);
+	node = metal_list_first(rpmsg_virtio_qpair_reclaimer(rvdev, qp));
 	if (node) {
 		r_desc = metal_container_of(node, struct vbuff_reclaimer_t, node);
 		metal_list_del(node);
@@ -197,17 +356,22 @@ static void *rpmsg_virtio_get_tx_buffer(struct rpmsg_virtio_device *rvdev,
 		if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev))
 			*len = rvdev->config.h2r_buf_size;
 		if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev))
-			*len = virtqueue_get_buffer_length(rvdev->svq, *idx);
+			*len = rpmsg_virtio_vq_get_buffer_length(qp->svq, *idx);
 	} else if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev)) {
-		data = virtqueue_get_buffer(rvdev->svq, len, idx);
-		if (!data && rvdev->svq->vq_free_cnt) {
+		data = rpmsg_virtio_vq_get_buffer(qp->svq, len, idx);
+		if (!data && qp->svq->vq_free_cnt) {
+			/* The pool is shared by the pairs, not by their locks */
+			if (rvdev->num_qpairs > 1)
+				metal_mutex_acquire(&rvdev->shpool_lock);
 			data = rpmsg_virtio_shm_pool_get_buffer(rvdev->shpool,
 					rvdev->config.h2r_buf_size);
+			if (rvdev->num_qpairs > 1)
+				metal_mutex_release(&rvdev->shpool_lock);
 			*len = rvdev->config.h2r_buf_size;
 			*idx = 0;
 		}
 	} else if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
-		data = virtqueue_get_first_avail_buffer(rvdev->svq, idx, len);
+		data = rpmsg_virtio_vq_get_first_avail_buffer(qp->svq, idx, len);
 	}
 
 	return data;
@@ -219,23 +383,25 @@ static void *rpmsg_virtio_get_tx_buffer(struct rpmsg_virtio_device *rvdev,
  * @brief Retrieves the received buffer from the virtqueue.
  *
  * @param rvdev	Pointer to rpmsg device
+ * @param qp	Queue pair to get the buffer from
  * @param len	Size of received buffer
  * @param idx	Index of buffer
  *
  * @return Pointer to received buffer
  */
 static void *rpmsg_virtio_get_rx_buffer(struct rpmsg_virtio_device *rvdev,
+					struct rpmsg_virtio_qpair *qp,
 					uint32_t *len, uint16_t *idx)
 {
 	void *data = NULL;
 
 	if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev)) {
-		data = virtqueue_get_buffer(rvdev->rvq, len, idx);
+		data = rpmsg_virtio_vq_get_buffer(qp->rvq, len, idx);
 	}
 
 	if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
 		data =
-		    virtqueue_get_first_avail_buffer(rvdev->rvq, idx, len);
+		    rpmsg_virtio_vq_get_first_avail_buffer(qp->rvq, idx, len);
 	}
 
 	/* Invalidate the buffer before returning it */
@@ -305,12 +471,26 @@ static bool rpmsg_virtio_buf_held_dec_test(struct rpmsg_hdr *rp_hdr)
 
 static void rpmsg_virtio_hold_rx_buffer(struct rpmsg_device *rdev, void *rxbuf)
 {
-	metal_mutex_acquire(&rdev->lock);
-	RPMSG_BUF_HELD_INC(RPMSG_LOCATE_HDR(rxbuf));
-	metal_mutex_release(&rdev->lock);
+	struct rpmsg_virtio_device *rvdev;
+	struct rpmsg_hdr *rp_hdr;
+	metal_mutex_t *lock;
+
+	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
+	rp_hdr = RPMSG_LOCATE_HDR(rxbuf);
+	lock = rpmsg_virtio_qpair_lock(rvdev,
+				       &rvdev->qpairs[RPMSG_BUF_QPAIR(rp_hdr)]);
+
+	metal_mutex_acquire(lock);
+	/* The counter shares the reserved field with the index and pair */
+	if (RPMSG_BUF_HELD_COUNTER(rp_hdr) >= RPMSG_BUF_HELD_MAX)
+		metal_err("buffer held counter overflow\r\n");
+	else
+		RPMSG_BUF_HELD_INC(rp_hdr);
+	metal_mutex_release(lock);
 }
 
 static bool rpmsg_virtio_release_rx_buffer_nolock(struct rpmsg_virtio_device *rvdev,
+						  struct rpmsg_virtio_qpair *qp,
 						  struct rpmsg_hdr *rp_hdr)
 {
 	uint16_t idx;
@@ -319,8 +499,8 @@ static bool rpmsg_virtio_release_rx_buffer_nolock(struct rpmsg_virtio_device *rv
 	/* The reserved field contains buffer index */
 	idx = RPMSG_BUF_INDEX(rp_hdr);
 	/* Return buffer on virtqueue. */
-	len = virtqueue_get_buffer_length(rvdev->rvq, idx);
-	rpmsg_virtio_return_buffer(rvdev, rp_hdr, len, idx);
+	len = rpmsg_virtio_vq_get_buffer_length(qp->rvq, idx);
+	rpmsg_virtio_return_buffer(rvdev, qp, rp_hdr, len, idx);
 
 	return true;
 }
@@ -329,18 +509,22 @@ static void rpmsg_virtio_release_rx_buffer(struct rpmsg_device *rdev,
 					   void *rxbuf)
 {
 	struct rpmsg_virtio_device *rvdev;
+	struct rpmsg_virtio_qpair *qp;
 	struct rpmsg_hdr *rp_hdr;
+	metal_mutex_t *lock;
 
 	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
 	rp_hdr = RPMSG_LOCATE_HDR(rxbuf);
+	qp = &rvdev->qpairs[RPMSG_BUF_QPAIR(rp_hdr)];
+	lock = rpmsg_virtio_qpair_lock(rvdev, qp);
 
-	metal_mutex_acquire(&rdev->lock);
+	metal_mutex_acquire(lock);
 	if (rpmsg_virtio_buf_held_dec_test(rp_hdr)) {
-		rpmsg_virtio_release_rx_buffer_nolock(rvdev, rp_hdr);
+		rpmsg_virtio_release_rx_buffer_nolock(rvdev, qp, rp_hdr);
 		/* Tell peer we returned an rx buffer */
-		virtqueue_kick(rvdev->rvq);
+		rpmsg_virtio_vq_kick(qp->rvq);
 	}
-	metal_mutex_release(&rdev->lock);
+	metal_mutex_release(lock);
 }
 
 static int rpmsg_virtio_notify_wait(struct rpmsg_virtio_device *rvdev, struct virtqueue *vq)
@@ -355,11 +539,14 @@ static int rpmsg_virtio_notify_wait(struct rpmsg_virtio_device *rvdev, struct vi
 	return rvdev->notify_wait_cb(&rvdev->rdev, vring_info->notifyid);
 }
 
-static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
-						uint32_t *len, int wait)
+static void *rpmsg_virtio_get_tx_payload_buffer_from(struct rpmsg_device *rdev,
+						     uint32_t src,
+						     uint32_t *len, int wait)
 {
 	struct rpmsg_virtio_device *rvdev;
+	struct rpmsg_virtio_qpair *qp;
 	struct rpmsg_hdr *rp_hdr;
+	metal_mutex_t *lock;
 	uint8_t virtio_status;
 	uint16_t idx;
 	int tick_count;
@@ -367,6 +554,8 @@ static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
 
 	/* Get the associated remote device for channel. */
 	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
+	qp = rpmsg_virtio_get_tx_qpair(rvdev, src);
+	lock = rpmsg_virtio_qpair_lock(rvdev, qp);
 
 	/* Validate device state */
 	status = virtio_get_status(rvdev->vdev, &virtio_status);
@@ -379,10 +568,10 @@ static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
 		tick_count = 0;
 
 	while (1) {
-		/* Lock the device to enable exclusive access to virtqueues */
-		metal_mutex_acquire(&rdev->lock);
-		rp_hdr = rpmsg_virtio_get_tx_buffer(rvdev, len, &idx);
-		metal_mutex_release(&rdev->lock);
+		/* Lock the queue pair to enable exclusive access to virtqueues */
+		metal_mutex_acquire(lock);
+		rp_hdr = rpmsg_virtio_get_tx_buffer(rvdev, qp, len, &idx);
+		metal_mutex_release(lock);
 		if (rp_hdr || !tick_count)
 			break;
 
@@ -390,7 +579,7 @@ static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
 		 * Try to use wait loop implemented in the virtio dispatcher and
 		 * use metal_sleep_usec() method by default.
 		 */
-		status = rpmsg_virtio_notify_wait(rvdev, rvdev->rvq);
+		status = rpmsg_virtio_notify_wait(rvdev, qp->rvq);
 		if (status == RPMSG_EOPNOTSUPP) {
 			metal_sleep_usec(RPMSG_TICKS_PER_INTERVAL);
 			tick_count--;
@@ -403,7 +592,7 @@ static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
 		return NULL;
 
 	/* Store the index into the reserved field to be used when sending */
-	rp_hdr->reserved = idx;
+	rp_hdr->reserved = RPMSG_BUF_RESERVED(idx, qp - rvdev->qpairs);
 
 	/* Increase the held counter to hold this Tx buffer */
 	RPMSG_BUF_HELD_INC(rp_hdr);
@@ -413,14 +602,23 @@ static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
 	return RPMSG_LOCATE_DATA(rp_hdr);
 }
 
+static void *rpmsg_virtio_get_tx_payload_buffer(struct rpmsg_device *rdev,
+						uint32_t *len, int wait)
+{
+	return rpmsg_virtio_get_tx_payload_buffer_from(rdev, RPMSG_ADDR_ANY,
+						       len, wait);
+}
+
 static int rpmsg_virtio_send_offchannel_nocopy(struct rpmsg_device *rdev,
 					       uint32_t src, uint32_t dst,
 					       const void *data, int len)
 {
 	struct rpmsg_virtio_device *rvdev;
+	struct rpmsg_virtio_qpair *qp;
 	struct metal_io_region *io;
 	struct rpmsg_hdr rp_hdr;
 	struct rpmsg_hdr *hdr;
+	metal_mutex_t *lock;
 	uint32_t buff_len;
 	uint16_t idx;
 	int status;
@@ -429,8 +627,10 @@ static int rpmsg_virtio_send_offchannel_nocopy(struct rpmsg_device *rdev,
 	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
 
 	hdr = RPMSG_LOCATE_HDR(data);
-	/* The reserved field contains buffer index */
-	idx = hdr->reserved;
+	/* The reserved field contains buffer index and queue pair */
+	idx = RPMSG_BUF_INDEX(hdr);
+	qp = &rvdev->qpairs[RPMSG_BUF_QPAIR(hdr)];
+	lock = rpmsg_virtio_qpair_lock(rvdev, qp);
 
 	/* Initialize RPMSG header. */
 	rp_hdr.dst = dst;
@@ -445,20 +645,20 @@ static int rpmsg_virtio_send_offchannel_nocopy(struct rpmsg_device *rdev,
 				      &rp_hdr, sizeof(rp_hdr));
 	RPMSG_ASSERT(status == sizeof(rp_hdr), "failed to write header\r\n");
 
-	metal_mutex_acquire(&rdev->lock);
+	metal_mutex_acquire(lock);
 
 	if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev))
 		buff_len = rvdev->config.h2r_buf_size;
 	else
-		buff_len = virtqueue_get_buffer_length(rvdev->svq, idx);
+		buff_len = rpmsg_virtio_vq_get_buffer_length(qp->svq, idx);
 
 	/* Enqueue buffer on virtqueue. */
-	status = rpmsg_virtio_enqueue_buffer(rvdev, hdr, buff_len, idx);
+	status = rpmsg_virtio_enqueue_buffer(rvdev, qp, hdr, buff_len, idx);
 	RPMSG_ASSERT(status == VQUEUE_SUCCESS, "failed to enqueue buffer\r\n");
 	/* Let the other side know that there is a job to process. */
-	virtqueue_kick(rvdev->svq);
+	rpmsg_virtio_vq_kick(qp->svq);
 
-	metal_mutex_release(&rdev->lock);
+	metal_mutex_release(lock);
 
 	return len;
 }
@@ -469,22 +669,45 @@ static int rpmsg_virtio_release_tx_buffer(struct rpmsg_device *rdev, void *txbuf
 	struct rpmsg_hdr *rp_hdr = RPMSG_LOCATE_HDR(txbuf);
 	void *vbuff = rp_hdr;  /* only used to avoid warning on the cast of a packed structure */
 	struct vbuff_reclaimer_t *r_desc = (struct vbuff_reclaimer_t *)vbuff;
+	struct rpmsg_virtio_qpair *qp;
+	struct metal_list *reclaimer;
+	metal_mutex_t *lock;
+	uint16_t idx;
+	int status;
 
 	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
+	qp = &rvdev->qpairs[RPMSG_BUF_QPAIR(rp_hdr)];
+	lock = rpmsg_virtio_qpair_lock(rvdev, qp);
 
-	metal_mutex_acquire(&rdev->lock);
+	metal_mutex_acquire(lock);
 
 	/* Check whether to release the Tx buffer */
 	if (rpmsg_virtio_buf_held_dec_test(rp_hdr)) {
-		/*
-		 * Reuse the RPMsg buffer to temporary store the vbuff_reclaimer_t structure.
-		 * Store the index locally before overwriting the RPMsg header.
-		 */
-		r_desc->idx = RPMSG_BUF_INDEX(rp_hdr);
-		metal_list_add_tail(&rvdev->reclaimer, &r_desc->node);
+		idx = RPMSG_BUF_INDEX(rp_hdr);
+		if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev) &&
+		    (rvdev->vdev->features & VIRTIO_RING_F_IN_ORDER)) {
+			/*
+			 * The buffers sent after this one are only used once
+			 * it is, return it empty now rather than on its reuse.
+			 */
+			status = rpmsg_virtio_enqueue_buffer(rvdev, qp, rp_hdr,
+							     0, idx);
+			RPMSG_ASSERT(status == VQUEUE_SUCCESS,
+				     "failed to enqueue buffer\r\n");
+			rpmsg_virtio_vq_kick(qp->svq);
+		} else {
+			/*
+			 * Reuse the RPMsg buffer to temporary store the
+			 * vbuff_reclaimer_t structure. Store the index locally
+			 * before overwriting the RPMsg header.
+			 */
+			r_desc->idx = idx;
+			reclaimer = rpmsg_virtio_qpair_reclaimer(rvdev, qp);
+			metal_list_add_tail(reclaimer, &r_desc->node);
+		}
 	}
 
-	metal_mutex_release(&rdev->lock);
+	metal_mutex_release(lock);
 
 	return RPMSG_SUCCESS;
 }
@@ -519,7 +742,8 @@ static int rpmsg_virtio_send_offchannel_raw(struct rpmsg_device *rdev,
 	rvdev = metal_container_of(rdev, struct rpmsg_virtio_device, rdev);
 
 	/* Get the payload buffer. */
-	buffer = rpmsg_virtio_get_tx_payload_buffer(rdev, &buff_len, wait);
+	buffer = rpmsg_virtio_get_tx_payload_buffer_from(rdev, src, &buff_len,
+							 wait);
 	if (!buffer)
 		return RPMSG_ERR_NO_BUFF;
 
@@ -559,6 +783,9 @@ static void rpmsg_virtio_rx_callback(struct virtqueue *vq)
 	struct virtio_device *vdev = vq->vq_dev;
 	struct rpmsg_virtio_device *rvdev = vdev->priv;
 	struct rpmsg_device *rdev = &rvdev->rdev;
+	unsigned int qp_idx = vq->vq_queue_index / RPMSG_NUM_VRINGS;
+	struct rpmsg_virtio_qpair *qp = &rvdev->qpairs[qp_idx];
+	metal_mutex_t *lock = rpmsg_virtio_qpair_lock(rvdev, qp);
 	struct rpmsg_endpoint *ept;
 	struct rpmsg_hdr *rp_hdr;
 	bool release = false;
@@ -568,24 +795,42 @@ static void rpmsg_virtio_rx_callback(struct virtqueue *vq)
 
 	while (1) {
 		/* Process the received data from remote node */
-		metal_mutex_acquire(&rdev->lock);
-		rp_hdr = rpmsg_virtio_get_rx_buffer(rvdev, &len, &idx);
+		metal_mutex_acquire(lock);
+		rp_hdr = rpmsg_virtio_get_rx_buffer(rvdev, qp, &len, &idx);
 
 		/* No more filled rx buffers */
 		if (!rp_hdr) {
 			if (VIRTIO_ENABLED(VQ_RX_EMPTY_NOTIFY) && release)
 				/* Tell peer we returned some rx buffer */
-				virtqueue_kick(rvdev->rvq);
-			metal_mutex_release(&rdev->lock);
+				rpmsg_virtio_vq_kick(qp->rvq);
+			metal_mutex_release(lock);
 			break;
 		}
 
-		rp_hdr->reserved = idx;
+		rp_hdr->reserved = RPMSG_BUF_RESERVED(idx, qp_idx);
+
+		/* Unsent buffer returned by an in-order device, no message */
+		if (!len) {
+			rpmsg_virtio_release_rx_buffer_nolock(rvdev, qp, rp_hdr);
+			if (VIRTIO_ENABLED(VQ_RX_EMPTY_NOTIFY))
+				release = true;
+			else
+				rpmsg_virtio_vq_kick(qp->rvq);
+			metal_mutex_release(lock);
+			continue;
+		}
+
+		RPMSG_BUF_HELD_INC(rp_hdr);
+
+		/* The endpoints are protected by the device lock */
+		if (lock != &rdev->lock) {
+			metal_mutex_release(lock);
+			metal_mutex_acquire(&rdev->lock);
+		}
 
 		/* Get the channel node from the remote device channels list. */
 		ept = rpmsg_get_ept_from_addr(rdev, rp_hdr->dst);
 		rpmsg_ept_incref(ept);
-		RPMSG_BUF_HELD_INC(rp_hdr);
 		metal_mutex_release(&rdev->lock);
 
 		if (ept) {
@@ -605,16 +850,20 @@ static void rpmsg_virtio_rx_callback(struct virtqueue *vq)
 
 		metal_mutex_acquire(&rdev->lock);
 		rpmsg_ept_decref(ept);
+		if (lock != &rdev->lock) {
+			metal_mutex_release(&rdev->lock);
+			metal_mutex_acquire(lock);
+		}
 		if (rpmsg_virtio_buf_held_dec_test(rp_hdr)) {
-			rpmsg_virtio_release_rx_buffer_nolock(rvdev, rp_hdr);
+			rpmsg_virtio_release_rx_buffer_nolock(rvdev, qp, rp_hdr);
 			if (VIRTIO_ENABLED(VQ_RX_EMPTY_NOTIFY))
 				/* Kick will be sent only when last buffer is released */
 				release = true;
 			else
 				/* Tell peer we returned an rx buffer */
-				virtqueue_kick(rvdev->rvq);
+				rpmsg_virtio_vq_kick(qp->rvq);
 		}
-		metal_mutex_release(&rdev->lock);
+		metal_mutex_release(lock);
 	}
 }
 
@@ -703,6 +952,38 @@ static int rpmsg_virtio_ns_callback(struct rpmsg_endpoint *ept, void *data,
 	return RPMSG_SUCCESS;
 }
 
+/**
+ * @internal
+ *
+ * @brief Get the size of the buffers provided by the host.
+ *
+ * The size of the next available buffer of the first queue pair which has
+ * one is returned.
+ *
+ * @param rvdev	Pointer to rpmsg virtio device
+ * @param tx	True for the send virtqueues, false for the receive ones
+ *
+ * @return Buffer size, 0 if no buffer is available.
+ */
+static uint32_t rpmsg_virtio_get_desc_size(struct rpmsg_virtio_device *rvdev,
+					   bool tx)
+{
+	struct rpmsg_virtio_qpair *qp;
+	metal_mutex_t *lock;
+	uint32_t size = 0;
+	unsigned int i;
+
+	for (i = 0; i < rvdev->num_qpairs && !size; i++) {
+		qp = &rvdev->qpairs[i];
+		lock = rpmsg_virtio_qpair_lock(rvdev, qp);
+		metal_mutex_acquire(lock);
+		size = virtqueue_get_desc_size(tx ? qp->svq : qp->rvq);
+		metal_mutex_release(lock);
+	}
+
+	return size;
+}
+
 int rpmsg_virtio_get_tx_buffer_size(struct rpmsg_device *rdev)
 {
 	struct rpmsg_virtio_device *rvdev;
@@ -711,7 +992,6 @@ int rpmsg_virtio_get_tx_buffer_size(struct rpmsg_device *rdev)
 	if (!rdev)
 		return RPMSG_ERR_PARAM;
 
-	metal_mutex_acquire(&rdev->lock);
 	rvdev = (struct rpmsg_virtio_device *)rdev;
 
 	if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev)) {
@@ -725,17 +1005,15 @@ int rpmsg_virtio_get_tx_buffer_size(struct rpmsg_device *rdev)
 	if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
 		/*
 		 * If other core is host then buffers are provided by it,
-		 * so get the buffer size from the virtqueue.
+		 * so get the buffer size from the virtqueues.
 		 */
-		size = (int)virtqueue_get_desc_size(rvdev->svq) -
+		size = (int)rpmsg_virtio_get_desc_size(rvdev, true) -
 		       sizeof(struct rpmsg_hdr);
 	}
 
 	if (size <= 0)
 		size = RPMSG_ERR_NO_BUFF;
 
-	metal_mutex_release(&rdev->lock);
-
 	return size;
 }
 
@@ -747,7 +1025,6 @@ int rpmsg_virtio_get_rx_buffer_size(struct rpmsg_device *rdev)
 	if (!rdev)
 		return RPMSG_ERR_PARAM;
 
-	metal_mutex_acquire(&rdev->lock);
 	rvdev = (struct rpmsg_virtio_device *)rdev;
 
 	if (VIRTIO_ROLE_IS_DRIVER(rvdev->vdev)) {
@@ -761,20 +1038,69 @@ int rpmsg_virtio_get_rx_buffer_size(struct rpmsg_device *rdev)
 	if (VIRTIO_ROLE_IS_DEVICE(rvdev->vdev)) {
 		/*
 		 * If other core is host then buffers are provided by it,
-		 * so get the buffer size from the virtqueue.
+		 * so get the buffer size from the virtqueues.
 		 */
-		size = (int)virtqueue_get_desc_size(rvdev->rvq) -
+		size = (int)rpmsg_virtio_get_desc_size(rvdev, false) -
 		       sizeof(struct rpmsg_hdr);
 	}
 
 	if (size <= 0)
 		size = RPMSG_ERR_NO_BUFF;
 
-	metal_mutex_release(&rdev->lock);
-
 	return size;
 }
 
+/**
+ * @internal
+ *
+ * @brief Agree on the number of queue pairs with the other side.
+ *
+ * With VIRTIO_RPMSG_F_QPAIRS, the host writes the number of pairs it uses in
+ * the config space before DRIVER_OK, and the remote reads it. Both sides use
+ * a single pair if the feature or the config space is missing.
+ *
+ * @param rvdev		Pointer to the rpmsg virtio device
+ * @param features	Negotiated features
+ *
+ * @return Number of queue pairs, or negative error code.
+ */
+static int rpmsg_virtio_negotiate_qpairs(struct rpmsg_virtio_device *rvdev,
+					 uint32_t features)
+{
+	struct virtio_device *vdev = rvdev->vdev;
+	uint32_t offset = metal_offset_of(struct rpmsg_virtio_dev_config,
+					  num_qpairs);
+	uint32_t max = vdev->vrings_num / RPMSG_NUM_VRINGS;
+	uint32_t num = 0;
+	uint32_t check = 0;
+
+	if (!(features & (1 << VIRTIO_RPMSG_F_QPAIRS)))
+		return 1;
+	if (!max)
+		return RPMSG_ERR_PARAM;
+	if (max > RPMSG_VIRTIO_MAX_QPAIRS)
+		max = RPMSG_VIRTIO_MAX_QPAIRS;
+
+	if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
+		num = rvdev->config.num_qpairs ? rvdev->config.num_qpairs : 1;
+		if (num > max)
+			num = max;
+		if (virtio_write_config(vdev, offset, &num, sizeof(num)) ||
+		    virtio_read_config(vdev, offset, &check, sizeof(check)) ||
+		    check != num)
+			return 1;
+	}
+
+	if (VIRTIO_ROLE_IS_DEVICE(vdev)) {
+		if (virtio_read_config(vdev, offset, &num, sizeof(num)) || !num)
+			return 1;
+		if (num > max)
+			return RPMSG_ERR_PARAM;
+	}
+
+	return (int)num;
+}
+
 int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 		    struct virtio_device *vdev,
 		    rpmsg_ns_bind_cb ns_bind_cb,
@@ -793,8 +1119,10 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 				const struct rpmsg_virtio_config *config)
 {
 	struct rpmsg_device *rdev;
-	const char *vq_names[RPMSG_NUM_VRINGS];
-	vq_callback callback[RPMSG_NUM_VRINGS];
+	const char *vq_names[RPMSG_NUM_VRINGS * RPMSG_VIRTIO_MAX_QPAIRS];
+	vq_callback callback[RPMSG_NUM_VRINGS * RPMSG_VIRTIO_MAX_QPAIRS];
+	struct rpmsg_virtio_qpair *qp;
+	unsigned int num_qpairs;
 	uint32_t features;
 	int status;
 	unsigned int i;
@@ -804,8 +1132,11 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 
 	rdev = &rvdev->rdev;
 	rvdev->notify_wait_cb = NULL;
+	rvdev->steer_cb = NULL;
 	memset(rdev, 0, sizeof(*rdev));
 	metal_mutex_init(&rdev->lock);
+	metal_mutex_init(&rvdev->shpool_lock);
+	metal_list_init(&rvdev->reclaimer);
 	rvdev->vdev = vdev;
 	rdev->ns_bind_cb = ns_bind_cb;
 	vdev->priv = rvdev;
@@ -817,6 +1148,8 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 	rdev->ops.release_tx_buffer = rpmsg_virtio_release_tx_buffer;
 	rdev->ops.get_rx_buffer_size = rpmsg_virtio_get_rx_buffer_size;
 	rdev->ops.get_tx_buffer_size = rpmsg_virtio_get_tx_buffer_size;
+	rdev->ops.get_tx_payload_buffer_from =
+		rpmsg_virtio_get_tx_payload_buffer_from;
 
 	if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
 		/*
@@ -827,6 +1160,8 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 			return RPMSG_ERR_PARAM;
 		}
 		rvdev->config = *config;
+		if (config->num_qpairs > RPMSG_VIRTIO_MAX_QPAIRS)
+			return RPMSG_ERR_PARAM;
 	}
 
 	if (VIRTIO_ROLE_IS_DEVICE(vdev)) {
@@ -841,6 +1176,11 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 		return status;
 	rdev->support_ns = !!(features & (1 << VIRTIO_RPMSG_F_NS));
 
+	status = rpmsg_virtio_negotiate_qpairs(rvdev, features);
+	if (status < 0)
+		return status;
+	num_qpairs = status;
+
 	if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
 		/*
 		 * Since device is RPMSG Remote so we need to manage the
@@ -852,47 +1192,60 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 		if (!shpool->size || !rvdev->shpool->size)
 			return RPMSG_ERR_NO_BUFF;
 
-		vq_names[0] = "rx_vq";
-		vq_names[1] = "tx_vq";
-		callback[0] = rpmsg_virtio_rx_callback;
-		callback[1] = rpmsg_virtio_tx_callback;
+		for (i = 0; i < num_qpairs; i++) {
+			vq_names[2 * i] = "rx_vq";
+			vq_names[2 * i + 1] = "tx_vq";
+			callback[2 * i] = rpmsg_virtio_rx_callback;
+			callback[2 * i + 1] = rpmsg_virtio_tx_callback;
+		}
 	}
 
 	if (VIRTIO_ROLE_IS_DEVICE(vdev)) {
-		vq_names[0] = "tx_vq";
-		vq_names[1] = "rx_vq";
-		callback[0] = rpmsg_virtio_tx_callback;
-		callback[1] = rpmsg_virtio_rx_callback;
+		for (i = 0; i < num_qpairs; i++) {
+			vq_names[2 * i] = "tx_vq";
+			vq_names[2 * i + 1] = "rx_vq";
+			callback[2 * i] = rpmsg_virtio_tx_callback;
+			callback[2 * i + 1] = rpmsg_virtio_rx_callback;
+		}
 	}
 
 	rvdev->shbuf_io = shm_io;
-	metal_list_init(&rvdev->reclaimer);
+	rvdev->num_qpairs = num_qpairs;
 
 	/* Create virtqueues for remote device */
-	status = virtio_create_virtqueues(vdev, 0, RPMSG_NUM_VRINGS,
+	status = virtio_create_virtqueues(vdev, 0,
+					  RPMSG_NUM_VRINGS * num_qpairs,
 					  vq_names, callback, NULL);
 	if (status != RPMSG_SUCCESS)
 		return status;
 
-	/* Create virtqueue success, assign back the virtqueue */
-	if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
-		rvdev->rvq  = vdev->vrings_info[0].vq;
-		rvdev->svq  = vdev->vrings_info[1].vq;
-	}
+	/* Create virtqueue success, assign back the virtqueues of each pair */
+	for (i = 0; i < num_qpairs; i++) {
+		qp = &rvdev->qpairs[i];
+		metal_mutex_init(&qp->lock);
+		metal_list_init(&qp->reclaimer);
 
-	if (VIRTIO_ROLE_IS_DEVICE(vdev)) {
-		rvdev->rvq  = vdev->vrings_info[1].vq;
-		rvdev->svq  = vdev->vrings_info[0].vq;
-	}
+		if (VIRTIO_ROLE_IS_DRIVER(vdev)) {
+			qp->rvq = vdev->vrings_info[2 * i].vq;
+			qp->svq = vdev->vrings_info[2 * i + 1].vq;
+		}
 
-	/*
-	 * Suppress "tx-complete" interrupts
-	 * since send method use busy loop when buffer pool exhaust
-	 */
-	virtqueue_disable_cb(rvdev->svq);
+		if (VIRTIO_ROLE_IS_DEVICE(vdev)) {
+			qp->rvq = vdev->vrings_info[2 * i + 1].vq;
+			qp->svq = vdev->vrings_info[2 * i].vq;
+		}
+
+		/*
+		 * Suppress "tx-complete" interrupts
+		 * since send method use busy loop when buffer pool exhaust
+		 */
+		virtqueue_disable_cb(qp->svq);
+	}
+	rvdev->rvq = rvdev->qpairs[0].rvq;
+	rvdev->svq = rvdev->qpairs[0].svq;
 
 	/* TODO: can have a virtio function to set the shared memory I/O */
-	for (i = 0; i < RPMSG_NUM_VRINGS; i++) {
+	for (i = 0; i < RPMSG_NUM_VRINGS * num_qpairs; i++) {
 		struct virtqueue *vq;
 
 		vq = vdev->vrings_info[i].vq;
@@ -905,28 +1258,31 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 		void *buffer;
 
 		vqbuf.len = rvdev->config.r2h_buf_size;
-		for (idx = 0; idx < rvdev->rvq->vq_nentries; idx++) {
-			/* Initialize TX virtqueue buffers for remote device */
-			buffer = rpmsg_virtio_shm_pool_get_buffer(shpool,
-					rvdev->config.r2h_buf_size);
-
-			if (!buffer) {
-				status = RPMSG_ERR_NO_BUFF;
-				goto err;
-			}
-
-			vqbuf.buf = buffer;
-
-			metal_io_block_set(shm_io,
-					   metal_io_virt_to_offset(shm_io,
-								   buffer),
-					   0x00, rvdev->config.r2h_buf_size);
-			status =
-				virtqueue_add_buffer(rvdev->rvq, &vqbuf, 0, 1,
-						     buffer);
-
-			if (status != RPMSG_SUCCESS) {
-				goto err;
+		for (i = 0; i < num_qpairs; i++) {
+			qp = &rvdev->qpairs[i];
+			for (idx = 0; idx < qp->rvq->vq_nentries; idx++) {
+				/* Initialize TX virtqueue buffers for remote device */
+				buffer = rpmsg_virtio_shm_pool_get_buffer(shpool,
+						rvdev->config.r2h_buf_size);
+
+				if (!buffer) {
+					status = RPMSG_ERR_NO_BUFF;
+					goto err;
+				}
+
+				vqbuf.buf = buffer;
+
+				metal_io_block_set(shm_io,
+						   metal_io_virt_to_offset(shm_io,
+									   buffer),
+						   0x00, rvdev->config.r2h_buf_size);
+				status =
+					virtqueue_add_buffer(qp->rvq, &vqbuf, 0, 1,
+							     buffer);
+
+				if (status != RPMSG_SUCCESS) {
+					goto err;
+				}
 			}
 		}
 	}
@@ -953,6 +1309,9 @@ int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
 	return RPMSG_SUCCESS;
 
 err:
+	for (i = 0; i < num_qpairs; i++)
+		metal_mutex_deinit(&rvdev->qpairs[i].lock);
+	metal_mutex_deinit(&rvdev->shpool_lock);
 	virtio_delete_virtqueues(vdev);
 	return status;
 }
@@ -962,6 +1321,7 @@ void rpmsg_deinit_vdev(struct rpmsg_virtio_device *rvdev)
 	struct metal_list *node;
 	struct rpmsg_device *rdev;
 	struct rpmsg_endpoint *ept;
+	unsigned int i;
 
 	if (rvdev) {
 		rdev = &rvdev->rdev;
@@ -973,8 +1333,15 @@ void rpmsg_deinit_vdev(struct rpmsg_virtio_device *rvdev)
 
 		rvdev->rvq = 0;
 		rvdev->svq = 0;
+		for (i = 0; i < rvdev->num_qpairs; i++) {
+			rvdev->qpairs[i].rvq = NULL;
+			rvdev->qpairs[i].svq = NULL;
+			metal_mutex_deinit(&rvdev->qpairs[i].lock);
+		}
+		rvdev->num_qpairs = 0;
 
 		virtio_delete_virtqueues(rvdev->vdev);
+		metal_mutex_deinit(&rvdev->shpool_lock);
 		metal_mutex_deinit(&rdev->lock);
 		rvdev->vdev = NULL;
 	}
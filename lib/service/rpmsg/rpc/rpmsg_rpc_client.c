@@ -6,8 +6,11 @@
  */
 
 #include <errno.h>
+#include <stddef.h>
 #include <openamp/rpmsg_rpc_client_server.h>
 
+#include "rpmsg_rpc_index.h"
+
 static int rpmsg_endpoint_client_cb(struct rpmsg_endpoint *, void *, size_t,
 				    uint32_t, void *);
 
@@ -37,45 +40,259 @@ int rpmsg_rpc_client_init(struct rpmsg_rpc_clt *rpc,
 	rpc->n_services = len;
 
 	rpc->shutdown_cb = shutdown_cb;
+	rpc->calls = NULL;
+	rpc->n_calls = 0;
+	rpc->shm = NULL;
+	rpmsg_rpc_index_init(&rpc->index, services, sizeof(*services), len);
 
 	ret = rpmsg_create_ept(&rpc->ept, rdev,
 			       RPMSG_RPC_SERVICE_NAME, RPMSG_ADDR_ANY,
 			       RPMSG_ADDR_ANY,
 			       rpmsg_endpoint_client_cb,
 			       rpmsg_service_client_unbind);
+	if (ret)
+		rpmsg_rpc_index_release(&rpc->index);
+
+	return ret;
+}
+
+int rpmsg_rpc_client_init_calls(struct rpmsg_rpc_clt *rpc,
+				struct rpmsg_rpc_call *calls, unsigned int num)
+{
+	unsigned int i;
+
+	if (!rpc || !calls || !num)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		calls[i].seq = 0;
+		atomic_init(&calls[i].done, 0);
+	}
+	metal_spinlock_init(&rpc->lock);
+	rpc->next_seq = 1;
+	rpc->n_calls = num;
+	rpc->calls = calls;
+
+	return 0;
+}
+
+/* Get the start of the message of the request params */
+static void *rpmsg_rpc_client_msg(struct rpmsg_rpc_clt *rpc, void *params)
+{
+	struct rpmsg_rpc_request *req;
+
+	req = metal_container_of(params, struct rpmsg_rpc_request, params);
+	if (rpc->calls)
+		return metal_container_of(req, struct rpmsg_rpc_seq_request,
+					  req);
+	return req;
+}
+
+void *rpmsg_rpc_client_get_tx_buffer(struct rpmsg_rpc_clt *rpc,
+				     uint32_t rpc_id, uint32_t *len, int wait)
+{
+	struct rpmsg_rpc_request *req;
+	uint32_t hdr_len;
+	void *msg;
+
+	if (!rpc || !len)
+		return NULL;
+
+	msg = rpmsg_get_tx_payload_buffer(&rpc->ept, len, wait);
+	if (!msg)
+		return NULL;
+
+	/* Pipelined requests are preceded by their sequence tag */
+	if (rpc->calls) {
+		req = &((struct rpmsg_rpc_seq_request *)msg)->req;
+		hdr_len = offsetof(struct rpmsg_rpc_seq_request, req.params);
+	} else {
+		req = msg;
+		hdr_len = MAX_FUNC_ID_LEN;
+	}
+	if (*len < hdr_len) {
+		rpmsg_release_tx_buffer(&rpc->ept, msg);
+		return NULL;
+	}
+
+	req->id = rpc_id;
+	*len -= hdr_len;
+	return req->params;
+}
+
+/* Allocate a pipelined call, must be called with the calls lock held */
+static struct rpmsg_rpc_call *rpmsg_rpc_client_get_call(struct rpmsg_rpc_clt *rpc)
+{
+	struct rpmsg_rpc_call *call;
+	unsigned int i;
+
+	for (i = 0; i < rpc->n_calls; i++) {
+		call = &rpc->calls[i];
+		if (call->seq)
+			continue;
+
+		call->seq = rpc->next_seq | RPMSG_RPC_SEQ_FLAG;
+		rpc->next_seq = (rpc->next_seq + 1) & ~RPMSG_RPC_SEQ_FLAG;
+		if (!rpc->next_seq)
+			rpc->next_seq = 1;
+		return call;
+	}
+
+	return NULL;
+}
+
+int rpmsg_rpc_client_call_nocopy(struct rpmsg_rpc_clt *rpc, void *params,
+				 size_t req_param_size, void *resp,
+				 size_t resp_len, struct rpmsg_rpc_call **call)
+{
+	struct rpmsg_rpc_seq_request *msg;
+	struct rpmsg_rpc_call *c;
+	int ret;
+
+	if (!rpc || !params || !rpc->calls)
+		return -EINVAL;
+
+	msg = rpmsg_rpc_client_msg(rpc, params);
+	metal_spinlock_acquire(&rpc->lock);
+	c = rpmsg_rpc_client_get_call(rpc);
+	metal_spinlock_release(&rpc->lock);
+	if (!c)
+		return -EBUSY;
+
+	c->id = msg->req.id;
+	c->handle = call != NULL;
+	c->resp = resp;
+	c->resp_len = resp ? resp_len : 0;
+	atomic_store(&c->done, 0);
+	msg->seq = c->seq;
+
+	ret = rpmsg_send_nocopy(&rpc->ept, msg,
+				offsetof(struct rpmsg_rpc_seq_request,
+					 req.params) + req_param_size);
+	if (ret < 0) {
+		metal_spinlock_acquire(&rpc->lock);
+		c->seq = 0;
+		metal_spinlock_release(&rpc->lock);
+		return ret;
+	}
+
+	if (call)
+		*call = c;
+	return ret;
+}
+
+int rpmsg_rpc_client_send_nocopy(struct rpmsg_rpc_clt *rpc, void *params,
+				 size_t req_param_size)
+{
+	if (!rpc || !params)
+		return -EINVAL;
+
+	if (rpc->calls)
+		return rpmsg_rpc_client_call_nocopy(rpc, params,
+						    req_param_size, NULL, 0,
+						    NULL);
+	return rpmsg_send_nocopy(&rpc->ept, rpmsg_rpc_client_msg(rpc, params),
+				 MAX_FUNC_ID_LEN + req_param_size);
+}
+
+int rpmsg_rpc_client_release_tx_buffer(struct rpmsg_rpc_clt *rpc,
+				       void *params)
+{
+	if (!rpc || !params)
+		return -EINVAL;
+
+	return rpmsg_release_tx_buffer(&rpc->ept,
+				       rpmsg_rpc_client_msg(rpc, params));
+}
+
+int rpmsg_rpc_client_call(struct rpmsg_rpc_clt *rpc, uint32_t rpc_id,
+			  void *request_param, size_t req_param_size,
+			  void *resp, size_t resp_len,
+			  struct rpmsg_rpc_call **call)
+{
+	void *params;
+	uint32_t len;
+	int ret;
+
+	if (!rpc || !rpc->calls)
+		return -EINVAL;
+
+	params = rpmsg_rpc_client_get_tx_buffer(rpc, rpc_id, &len, 1);
+	if (!params)
+		return RPMSG_ERR_NO_BUFF;
+	if (req_param_size > len) {
+		rpmsg_rpc_client_release_tx_buffer(rpc, params);
+		return -EINVAL;
+	}
+
+	if (req_param_size)
+		memcpy(params, request_param, req_param_size);
+	ret = rpmsg_rpc_client_call_nocopy(rpc, params, req_param_size,
+					   resp, resp_len, call);
+	if (ret < 0)
+		rpmsg_rpc_client_release_tx_buffer(rpc, params);
 
 	return ret;
 }
 
+int rpmsg_rpc_client_complete(struct rpmsg_rpc_clt *rpc,
+			      struct rpmsg_rpc_call *call, int *status)
+{
+	int len;
+
+	if (!rpc || !call || !call->seq)
+		return -EINVAL;
+	if (!atomic_load(&call->done))
+		return -EAGAIN;
+
+	if (status)
+		*status = call->status;
+	len = call->len;
+	metal_spinlock_acquire(&rpc->lock);
+	call->seq = 0;
+	metal_spinlock_release(&rpc->lock);
+
+	return len;
+}
+
 int rpmsg_rpc_client_send(struct rpmsg_rpc_clt *rpc,
 			  uint32_t rpc_id, void *request_param,
 			  size_t req_param_size)
 {
-	unsigned char tmpbuf[MAX_BUF_LEN];
+	void *params;
+	uint32_t len;
+	int ret;
 
 	if (!rpc)
 		return -EINVAL;
 
-	/* to optimize with the zero copy API */
-	memcpy(tmpbuf, &rpc_id, MAX_FUNC_ID_LEN);
-	memcpy(&tmpbuf[MAX_FUNC_ID_LEN], request_param, req_param_size);
-	return rpmsg_send(&rpc->ept, tmpbuf, MAX_FUNC_ID_LEN + req_param_size);
+	/* Marshal the request straight into the shared memory TX buffer */
+	params = rpmsg_rpc_client_get_tx_buffer(rpc, rpc_id, &len, 1);
+	if (!params)
+		return RPMSG_ERR_NO_BUFF;
+	if (req_param_size > len) {
+		rpmsg_rpc_client_release_tx_buffer(rpc, params);
+		return -EINVAL;
+	}
+
+	if (req_param_size)
+		memcpy(params, request_param, req_param_size);
+	ret = rpmsg_rpc_client_send_nocopy(rpc, params, req_param_size);
+	if (ret < 0)
+		rpmsg_rpc_client_release_tx_buffer(rpc, params);
+
+	return ret;
 }
 
 static const struct rpmsg_rpc_client_services *find_service(struct
 							    rpmsg_rpc_clt * rpc,
 							    uint32_t id)
 {
-	const struct rpmsg_rpc_client_services *service;
-
-	for (unsigned int i = 0; i < rpc->n_services; i++) {
-		service = &rpc->services[i];
+	int i;
 
-		if (service->id == id) {
-			return service;
-		}
-	}
-	return NULL;
+	i = rpmsg_rpc_index_find(&rpc->index, rpc->services,
+				 sizeof(*rpc->services), rpc->n_services, id);
+	return i < 0 ? NULL : &rpc->services[i];
 }
 
 void rpmsg_rpc_client_release(struct rpmsg_rpc_clt *rpc)
@@ -83,7 +300,55 @@ void rpmsg_rpc_client_release(struct rpmsg_rpc_clt *rpc)
 	if (!rpc)
 		return;
 	rpmsg_destroy_ept(&rpc->ept);
+	rpmsg_rpc_index_release(&rpc->index);
+
+}
+
+/* Complete the pipelined call of an answer */
+static int rpmsg_rpc_client_answer(struct rpmsg_rpc_clt *rpc,
+				   struct rpmsg_rpc_answer *msg, size_t len)
+{
+	const struct rpmsg_rpc_client_services *service;
+	struct rpmsg_rpc_call *call = NULL;
+	size_t param_len;
+	unsigned int i;
+
+	if (len < offsetof(struct rpmsg_rpc_answer, params))
+		return -EINVAL;
+
+	metal_spinlock_acquire(&rpc->lock);
+	for (i = 0; i < rpc->n_calls; i++) {
+		if (rpc->calls[i].seq == msg->id) {
+			call = &rpc->calls[i];
+			break;
+		}
+	}
+	metal_spinlock_release(&rpc->lock);
+	if (!call)
+		return -EINVAL;
+
+	if (!call->handle) {
+		/* No call handle, the call is done once passed to its service */
+		service = find_service(rpc, call->id);
+		metal_spinlock_acquire(&rpc->lock);
+		call->seq = 0;
+		metal_spinlock_release(&rpc->lock);
+		if (!service)
+			return -EINVAL;
+		service->cb(rpc, msg->status, msg->params, len);
+		return RPMSG_SUCCESS;
+	}
 
+	param_len = len - offsetof(struct rpmsg_rpc_answer, params);
+	if (param_len > call->resp_len)
+		param_len = call->resp_len;
+	if (param_len)
+		memcpy(call->resp, msg->params, param_len);
+	call->status = msg->status;
+	call->len = param_len;
+	atomic_store(&call->done, 1);
+
+	return RPMSG_SUCCESS;
 }
 
 static int rpmsg_endpoint_client_cb(struct rpmsg_endpoint *ept,
@@ -104,6 +369,9 @@ static int rpmsg_endpoint_client_cb(struct rpmsg_endpoint *ept,
 	rpc = metal_container_of(ept,
 				 struct rpmsg_rpc_clt,
 				 ept);
+	if (msg->id & RPMSG_RPC_SEQ_FLAG)
+		return rpmsg_rpc_client_answer(rpc, msg, len);
+
 	service = find_service(rpc, msg->id);
 	if (!service)
 		return -EINVAL;
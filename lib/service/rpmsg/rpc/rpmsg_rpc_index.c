@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <metal/alloc.h>
+#include <string.h>
+
+#include "rpmsg_rpc_index.h"
+
+/* Jump tables are used up to this number of slots per service */
+#define RPMSG_RPC_INDEX_DENSITY 2
+
+/* Service ID of a table entry */
+#define RPMSG_RPC_INDEX_ID(table, stride, i) \
+	(*(const uint32_t *)((const char *)(table) + (size_t)(i) * (stride)))
+
+void rpmsg_rpc_index_init(struct rpmsg_rpc_index *index, const void *table,
+			  size_t stride, unsigned int num)
+{
+	uint32_t id, min, max, span;
+	unsigned int i, j, direct = 1, sorted = 1;
+	unsigned short slot;
+
+	index->mode = RPMSG_RPC_INDEX_LINEAR;
+	index->slots = NULL;
+	index->base = 0;
+	index->num = 0;
+	if (!table || !num || num > (unsigned short)-1)
+		return;
+
+	min = RPMSG_RPC_INDEX_ID(table, stride, 0);
+	max = min;
+	for (i = 1; i < num; i++) {
+		id = RPMSG_RPC_INDEX_ID(table, stride, i);
+		if (id != RPMSG_RPC_INDEX_ID(table, stride, 0) + i)
+			direct = 0;
+		if (id < RPMSG_RPC_INDEX_ID(table, stride, i - 1))
+			sorted = 0;
+		if (id < min)
+			min = id;
+		if (id > max)
+			max = id;
+	}
+	index->base = min;
+
+	/* Entry i serves ID base + i, the table is its own jump table */
+	if (direct) {
+		index->mode = RPMSG_RPC_INDEX_DIRECT;
+		return;
+	}
+
+	/* Compact IDs, jump table of the table index + 1 of each ID */
+	span = max - min;
+	if (span < num * RPMSG_RPC_INDEX_DENSITY) {
+		index->slots = metal_allocate_memory((span + 1) *
+						     sizeof(*index->slots));
+		if (index->slots) {
+			memset(index->slots, 0,
+			       (span + 1) * sizeof(*index->slots));
+			for (i = num; i > 0; i--) {
+				id = RPMSG_RPC_INDEX_ID(table, stride, i - 1);
+				index->slots[id - min] = i;
+			}
+			index->num = span + 1;
+			index->mode = RPMSG_RPC_INDEX_DENSE;
+			return;
+		}
+	}
+
+	/* Sparse IDs, binary search in the table or in its sorted indexes */
+	if (sorted) {
+		index->mode = RPMSG_RPC_INDEX_SORTED;
+		return;
+	}
+	index->slots = metal_allocate_memory(num * sizeof(*index->slots));
+	if (!index->slots)
+		return;
+	for (i = 0; i < num; i++) {
+		slot = i;
+		id = RPMSG_RPC_INDEX_ID(table, stride, i);
+		for (j = i; j > 0; j--) {
+			if (RPMSG_RPC_INDEX_ID(table, stride,
+					       index->slots[j - 1]) <= id)
+				break;
+			index->slots[j] = index->slots[j - 1];
+		}
+		index->slots[j] = slot;
+	}
+	index->num = num;
+	index->mode = RPMSG_RPC_INDEX_SORTED;
+}
+
+void rpmsg_rpc_index_release(struct rpmsg_rpc_index *index)
+{
+	if (index->slots)
+		metal_free_memory(index->slots);
+	index->slots = NULL;
+	index->mode = RPMSG_RPC_INDEX_LINEAR;
+}
+
+int rpmsg_rpc_index_find(const struct rpmsg_rpc_index *index,
+			 const void *table, size_t stride, unsigned int num,
+			 uint32_t id)
+{
+	unsigned int i, lo, hi, mid;
+
+	switch (index->mode) {
+	case RPMSG_RPC_INDEX_DIRECT:
+		i = id - index->base;
+		return id >= index->base && i < num ? (int)i : -1;
+	case RPMSG_RPC_INDEX_DENSE:
+		i = id - index->base;
+		if (id < index->base || i >= index->num)
+			return -1;
+		return (int)index->slots[i] - 1;
+	case RPMSG_RPC_INDEX_SORTED:
+		/* Lower bound, to return the first entry with the ID */
+		lo = 0;
+		hi = num;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			i = index->slots ? index->slots[mid] : mid;
+			if (RPMSG_RPC_INDEX_ID(table, stride, i) < id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == num)
+			return -1;
+		i = index->slots ? index->slots[lo] : lo;
+		return RPMSG_RPC_INDEX_ID(table, stride, i) == id ? (int)i : -1;
+	default:
+		for (i = 0; i < num; i++) {
+			if (RPMSG_RPC_INDEX_ID(table, stride, i) == id)
+				return (int)i;
+		}
+		return -1;
+	}
+}
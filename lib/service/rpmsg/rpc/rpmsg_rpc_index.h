@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _RPMSG_RPC_INDEX_H_
+#define _RPMSG_RPC_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <openamp/rpmsg_rpc_client_server.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @internal
+ *
+ * @brief Build the service ID lookup index of a services table
+ *
+ * The entries of the table start with their uint32_t service ID. The index
+ * falls back to a linear scan if its slots cannot be allocated.
+ *
+ * @param index		Pointer to the index
+ * @param table		Pointer to the services table
+ * @param stride	Size of a table entry
+ * @param num		Number of table entries
+ */
+void rpmsg_rpc_index_init(struct rpmsg_rpc_index *index, const void *table,
+			  size_t stride, unsigned int num);
+
+/**
+ * @internal
+ *
+ * @brief Release the service ID lookup index
+ *
+ * @param index	Pointer to the index
+ */
+void rpmsg_rpc_index_release(struct rpmsg_rpc_index *index);
+
+/**
+ * @internal
+ *
+ * @brief Find a service ID in a services table
+ *
+ * @param index		Pointer to the index of the table
+ * @param table		Pointer to the services table
+ * @param stride	Size of a table entry
+ * @param num		Number of table entries
+ * @param id		Service ID
+ *
+ * @return Table index of the first entry with the ID, -1 if not found.
+ */
+int rpmsg_rpc_index_find(const struct rpmsg_rpc_index *index,
+			 const void *table, size_t stride, unsigned int num,
+			 uint32_t id);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif /* _RPMSG_RPC_INDEX_H_ */
@@ -6,8 +6,11 @@
  */
 
 #include <errno.h>
+#include <stddef.h>
 #include <openamp/rpmsg_rpc_client_server.h>
 
+#include "rpmsg_rpc_index.h"
+
 #define LPERROR(format, ...) metal_log(METAL_LOG_ERROR, format, ##__VA_ARGS__)
 
 static int rpmsg_endpoint_server_cb(struct rpmsg_endpoint *, void *,
@@ -21,78 +24,358 @@ int rpmsg_rpc_server_init(struct rpmsg_rpc_svr *rpcs, struct rpmsg_device *rdev,
 
 	rpcs->services = services;
 	rpcs->n_services = len;
+	rpcs->seq = 0;
+	rpcs->server = NULL;
+	rpcs->work = NULL;
+	rpcs->works = NULL;
+	rpcs->n_works = 0;
+	rpcs->shm = NULL;
+	rpmsg_rpc_index_init(&rpcs->index, services, sizeof(*services), len);
 
 	ret = rpmsg_create_ept(&rpcs->ept, rdev, RPMSG_RPC_SERVICE_NAME,
 			       RPMSG_ADDR_ANY, RPMSG_ADDR_ANY,
 			       rpmsg_endpoint_server_cb,
 			       rpmsg_service_server_unbind);
 	if (ret)
-		return ret;
+		rpmsg_rpc_index_release(&rpcs->index);
 
 	return ret;
 }
 
+void rpmsg_rpc_server_release(struct rpmsg_rpc_svr *rpcs)
+{
+	if (!rpcs)
+		return;
+	rpmsg_destroy_ept(&rpcs->ept);
+	rpmsg_rpc_index_release(&rpcs->index);
+	if (rpcs->works) {
+		/* A libmetal condition holds no resource, only the lock does */
+		metal_mutex_deinit(&rpcs->works_lock);
+		rpcs->works = NULL;
+		rpcs->n_works = 0;
+	}
+}
+
 static const struct rpmsg_rpc_services *find_service(struct rpmsg_rpc_svr *rpcs,
 						     unsigned int id)
 {
-	const struct rpmsg_rpc_services *service;
+	int i;
+
+	i = rpmsg_rpc_index_find(&rpcs->index, rpcs->services,
+				 sizeof(*rpcs->services), rpcs->n_services, id);
+	return i < 0 ? NULL : &rpcs->services[i];
+}
+
+/* Server of a worker handle, or the server itself */
+static struct rpmsg_rpc_svr *rpmsg_rpc_server_of(struct rpmsg_rpc_svr *rpcs)
+{
+	return rpcs->server ? rpcs->server : rpcs;
+}
+
+/* The answer of a pipelined request carries its tag in place of the ID */
+static uint32_t rpmsg_rpc_server_tag(struct rpmsg_rpc_svr *rpcs,
+				     uint32_t rpc_id)
+{
+	uint32_t seq = rpcs->work ? rpcs->work->seq : rpcs->seq;
 
-	for (unsigned int i = 0; i < rpcs->n_services; i++) {
-		service = &rpcs->services[i];
+	if (rpc_id & RPMSG_RPC_SEQ_FLAG)
+		return rpc_id;
 
-		if (service->id == id) {
-			return service;
+	return seq ? seq : rpc_id;
+}
+
+/* Get a TX buffer for an answer with the final ID, tag included */
+static void *rpmsg_rpc_server_get_answer(struct rpmsg_rpc_svr *rpcs,
+					 uint32_t answer_id, uint32_t *len,
+					 int wait)
+{
+	struct rpmsg_rpc_answer *msg;
+
+	msg = rpmsg_get_tx_payload_buffer(&rpcs->ept, len, wait);
+	if (!msg)
+		return NULL;
+	if (*len < offsetof(struct rpmsg_rpc_answer, params)) {
+		rpmsg_release_tx_buffer(&rpcs->ept, msg);
+		return NULL;
+	}
+
+	msg->id = answer_id;
+	*len -= offsetof(struct rpmsg_rpc_answer, params);
+	return msg->params;
+}
+
+/* Send an answer with the final ID, tag included */
+static int rpmsg_rpc_server_send_answer(struct rpmsg_rpc_svr *rpcs,
+					uint32_t answer_id, int status,
+					void *request_param, size_t param_size)
+{
+	void *params;
+	uint32_t len;
+	int ret;
+
+	if (param_size > MAX_BUF_LEN - sizeof(int32_t))
+		return -EINVAL;
+
+	/* Marshal the answer straight into the shared memory TX buffer */
+	params = rpmsg_rpc_server_get_answer(rpcs, answer_id, &len, 1);
+	if (!params)
+		return RPMSG_ERR_NO_BUFF;
+	if (param_size > len) {
+		rpmsg_rpc_server_release_tx_buffer(rpcs, params);
+		return -EINVAL;
+	}
+
+	if (param_size)
+		memcpy(params, request_param, param_size);
+	ret = rpmsg_rpc_server_send_nocopy(rpcs, params, status, param_size);
+	if (ret < 0)
+		rpmsg_rpc_server_release_tx_buffer(rpcs, params);
+
+	return ret;
+}
+
+/* Hold the RX buffer of a request and queue it to the workers */
+static int rpmsg_rpc_server_queue(struct rpmsg_rpc_svr *rpcs, void *rxbuf,
+				  struct rpmsg_rpc_request *req,
+				  const struct rpmsg_rpc_services *service,
+				  uint32_t seq)
+{
+	struct rpmsg_rpc_work *work = NULL;
+	unsigned int i;
+
+	metal_mutex_acquire(&rpcs->works_lock);
+	for (i = 0; i < rpcs->n_works; i++) {
+		if (!rpcs->works[i].rxbuf) {
+			work = &rpcs->works[i];
+			break;
 		}
 	}
-	return NULL;
+	if (!work) {
+		metal_mutex_release(&rpcs->works_lock);
+		return -EBUSY;
+	}
+
+	rpmsg_hold_rx_buffer(&rpcs->ept, rxbuf);
+	work->rxbuf = rxbuf;
+	work->req = req;
+	work->service = service;
+	work->seq = seq;
+	work->ticket = rpcs->next_ticket++;
+	work->busy = 0;
+	metal_condition_signal(&rpcs->works_cond);
+	metal_mutex_release(&rpcs->works_lock);
+
+	return 0;
 }
 
 static int rpmsg_endpoint_server_cb(struct rpmsg_endpoint *ept, void *data,
 				    size_t len,
 				    uint32_t src, void *priv)
 {
-	unsigned char buf[MAX_BUF_LEN];
+	struct rpmsg_rpc_request *req = data;
 	unsigned int id;
 	const struct rpmsg_rpc_services *service;
 	struct rpmsg_rpc_svr *rpcs;
+	uint32_t seq = 0;
 	(void)priv;
 	(void)src;
 
-	if (len > MAX_BUF_LEN)
+	/* Pipelined requests start with their sequence tag */
+	if (len >= MAX_FUNC_ID_LEN && req->id & RPMSG_RPC_SEQ_FLAG) {
+		seq = req->id;
+		req = &((struct rpmsg_rpc_seq_request *)data)->req;
+		len -= offsetof(struct rpmsg_rpc_seq_request, req);
+	}
+	if (len < MAX_FUNC_ID_LEN || len > MAX_BUF_LEN)
 		return -EINVAL;
 
 	rpcs = metal_container_of(ept, struct rpmsg_rpc_svr, ept);
 
-	memcpy(buf, data, len);
-	id = *buf;
+	/* The request is processed in place in the RX buffer */
+	id = req->id;
 	service = find_service(rpcs, id);
 
-	if (service) {
-		if (service->cb_function(buf, rpcs)) {
-			LPERROR("Service failed at rpc id: %ld\r\n", id);
-		}
-	} else {
-		LPERROR("Handling remote procedure call errors: rpc id %ld\r\n",
+	if (!service) {
+		LPERROR("Handling remote procedure call errors: rpc id %u\r\n",
 			id);
-		rpmsg_rpc_server_send(rpcs, id, RPMSG_RPC_INVALID_ID, NULL, 0);
+		rpmsg_rpc_server_send_answer(rpcs, seq ? seq : id,
+					     RPMSG_RPC_INVALID_ID, NULL, 0);
+		return RPMSG_SUCCESS;
+	}
+
+	if (rpcs->works) {
+		if (rpmsg_rpc_server_queue(rpcs, data, req, service, seq)) {
+			LPERROR("No worker for rpc id: %u\r\n", id);
+			rpmsg_rpc_server_send_answer(rpcs, seq ? seq : id,
+						     RPMSG_RPC_BUSY, NULL, 0);
+		}
+		return RPMSG_SUCCESS;
 	}
+
+	/* The answers sent while serving the request are tagged with seq */
+	rpcs->seq = seq;
+	if (service->cb_function(req, rpcs)) {
+		LPERROR("Service failed at rpc id: %u\r\n", id);
+	}
+	rpcs->seq = 0;
 	return RPMSG_SUCCESS;
 }
 
-int rpmsg_rpc_server_send(struct rpmsg_rpc_svr *rpcs, uint32_t rpc_id,
-			  int status, void *request_param, size_t param_size)
+void *rpmsg_rpc_server_hold_request(struct rpmsg_rpc_svr *rpcs, void *data)
 {
-	struct rpmsg_endpoint *ept = &rpcs->ept;
-	struct rpmsg_rpc_answer msg;
+	void *rxbuf = data;
+
+	if (rpcs->work)
+		rxbuf = rpcs->work->rxbuf;
+	else if (rpcs->seq)
+		rxbuf = metal_container_of(data, struct rpmsg_rpc_seq_request,
+					   req);
+	rpmsg_hold_rx_buffer(&rpmsg_rpc_server_of(rpcs)->ept, rxbuf);
 
-	if (!ept)
+	return rxbuf;
+}
+
+uint32_t rpmsg_rpc_server_answer_id(struct rpmsg_rpc_svr *rpcs, void *data)
+{
+	struct rpmsg_rpc_request *req = data;
+
+	return rpmsg_rpc_server_tag(rpcs, req->id);
+}
+
+int rpmsg_rpc_server_init_workers(struct rpmsg_rpc_svr *rpcs,
+				  struct rpmsg_rpc_work *works,
+				  unsigned int num)
+{
+	unsigned int i;
+
+	if (!rpcs || !works || !num || rpcs->works)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++)
+		works[i].rxbuf = NULL;
+	metal_mutex_init(&rpcs->works_lock);
+	metal_condition_init(&rpcs->works_cond);
+	rpcs->next_ticket = 0;
+	rpcs->works_stop = 0;
+	rpcs->n_works = num;
+	rpcs->works = works;
+
+	return 0;
+}
+
+int rpmsg_rpc_server_work(struct rpmsg_rpc_svr *rpcs)
+{
+	struct rpmsg_rpc_work *work;
+	struct rpmsg_rpc_svr worker;
+	unsigned int i;
+	int ret;
+
+	if (!rpcs || !rpcs->works)
+		return -EINVAL;
+
+	metal_mutex_acquire(&rpcs->works_lock);
+	while (1) {
+		/* Serve the requests in their queuing order */
+		work = NULL;
+		for (i = 0; i < rpcs->n_works; i++) {
+			if (!rpcs->works[i].rxbuf || rpcs->works[i].busy)
+				continue;
+			if (!work ||
+			    (int)(rpcs->works[i].ticket - work->ticket) < 0)
+				work = &rpcs->works[i];
+		}
+		if (work || rpcs->works_stop)
+			break;
+		ret = metal_condition_wait(&rpcs->works_cond,
+					   &rpcs->works_lock);
+		if (ret) {
+			metal_mutex_release(&rpcs->works_lock);
+			return ret;
+		}
+	}
+	if (!work) {
+		metal_mutex_release(&rpcs->works_lock);
+		return -EPIPE;
+	}
+	work->busy = 1;
+	metal_mutex_release(&rpcs->works_lock);
+
+	/* The service answers through a handle bound to its request */
+	memset(&worker, 0, sizeof(worker));
+	worker.ept = rpcs->ept;
+	worker.services = rpcs->services;
+	worker.n_services = rpcs->n_services;
+	worker.shm = rpcs->shm;
+	worker.server = rpcs;
+	worker.work = work;
+	if (work->service->cb_function(work->req, &worker)) {
+		LPERROR("Service failed at rpc id: %u\r\n", work->req->id);
+	}
+	rpmsg_release_rx_buffer(&rpcs->ept, work->rxbuf);
+
+	metal_mutex_acquire(&rpcs->works_lock);
+	work->rxbuf = NULL;
+	metal_mutex_release(&rpcs->works_lock);
+
+	return 0;
+}
+
+void rpmsg_rpc_server_stop_workers(struct rpmsg_rpc_svr *rpcs)
+{
+	if (!rpcs || !rpcs->works)
+		return;
+
+	metal_mutex_acquire(&rpcs->works_lock);
+	rpcs->works_stop = 1;
+	metal_condition_broadcast(&rpcs->works_cond);
+	metal_mutex_release(&rpcs->works_lock);
+}
+
+void *rpmsg_rpc_server_get_tx_buffer(struct rpmsg_rpc_svr *rpcs,
+				     uint32_t rpc_id, uint32_t *len, int wait)
+{
+	if (!rpcs || !len)
+		return NULL;
+
+	return rpmsg_rpc_server_get_answer(rpmsg_rpc_server_of(rpcs),
+					   rpmsg_rpc_server_tag(rpcs, rpc_id),
+					   len, wait);
+}
+
+int rpmsg_rpc_server_send_nocopy(struct rpmsg_rpc_svr *rpcs, void *params,
+				 int status, size_t param_size)
+{
+	struct rpmsg_rpc_answer *msg;
+
+	if (!rpcs || !params)
 		return -EINVAL;
-	if (param_size > (MAX_BUF_LEN - sizeof(msg.status)))
+
+	msg = metal_container_of(params, struct rpmsg_rpc_answer, params);
+	msg->status = status;
+	return rpmsg_send_nocopy(&rpmsg_rpc_server_of(rpcs)->ept, msg,
+				 offsetof(struct rpmsg_rpc_answer, params) +
+				 param_size);
+}
+
+int rpmsg_rpc_server_release_tx_buffer(struct rpmsg_rpc_svr *rpcs,
+				       void *params)
+{
+	struct rpmsg_rpc_answer *msg;
+
+	if (!rpcs || !params)
 		return -EINVAL;
 
-	msg.id = rpc_id;
-	msg.status = status;
-	memcpy(msg.params, request_param, param_size);
+	msg = metal_container_of(params, struct rpmsg_rpc_answer, params);
+	return rpmsg_release_tx_buffer(&rpmsg_rpc_server_of(rpcs)->ept, msg);
+}
+
+int rpmsg_rpc_server_send(struct rpmsg_rpc_svr *rpcs, uint32_t rpc_id,
+			  int status, void *request_param, size_t param_size)
+{
+	if (!rpcs)
+		return -EINVAL;
 
-	return rpmsg_send(ept, &msg, MAX_FUNC_ID_LEN + param_size);
+	return rpmsg_rpc_server_send_answer(rpmsg_rpc_server_of(rpcs),
+					    rpmsg_rpc_server_tag(rpcs, rpc_id),
+					    status, request_param, param_size);
 }
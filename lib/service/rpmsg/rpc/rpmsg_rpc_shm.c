@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2026, OpenAMP contributors
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <metal/alloc.h>
+#include <metal/cache.h>
+#include <metal/utilities.h>
+#include <openamp/rpmsg_rpc_client_server.h>
+
+int rpmsg_rpc_shm_init(struct rpmsg_rpc_shm *shm, struct metal_io_region *io,
+		       size_t block_size)
+{
+	size_t size;
+
+	if (!shm || !io)
+		return -EINVAL;
+
+	/* The descriptors hold 32-bit offsets and lengths */
+	size = metal_io_region_size(io);
+	if (size > UINT32_MAX)
+		size = UINT32_MAX;
+
+	shm->io = io;
+	shm->block_size = block_size;
+	shm->num_blocks = 0;
+	shm->bitmap = NULL;
+	metal_spinlock_init(&shm->lock);
+	if (!block_size)
+		return 0;
+
+	shm->num_blocks = size / block_size;
+	if (!shm->num_blocks)
+		return -EINVAL;
+	size = metal_bitmap_longs(shm->num_blocks) * sizeof(*shm->bitmap);
+	shm->bitmap = metal_allocate_memory(size);
+	if (!shm->bitmap)
+		return -ENOMEM;
+	memset(shm->bitmap, 0, size);
+
+	return 0;
+}
+
+void rpmsg_rpc_shm_release(struct rpmsg_rpc_shm *shm)
+{
+	if (!shm)
+		return;
+	if (shm->bitmap)
+		metal_free_memory(shm->bitmap);
+	shm->bitmap = NULL;
+	shm->num_blocks = 0;
+}
+
+void *rpmsg_rpc_shm_alloc(struct rpmsg_rpc_shm *shm, size_t len,
+			  struct rpmsg_rpc_shm_desc *desc)
+{
+	unsigned int first, last, num, bit;
+
+	if (!shm || !shm->bitmap || !len || !desc)
+		return NULL;
+	if (len > shm->num_blocks * shm->block_size)
+		return NULL;
+	num = metal_div_round_up(len, shm->block_size);
+
+	/* First fit of num contiguous free blocks */
+	metal_spinlock_acquire(&shm->lock);
+	first = metal_bitmap_next_clear_bit(shm->bitmap, 0, shm->num_blocks);
+	while (first + num <= shm->num_blocks) {
+		for (last = first + 1; last < first + num; last++) {
+			if (metal_bitmap_is_bit_set(shm->bitmap, last))
+				break;
+		}
+		if (last == first + num)
+			break;
+		first = metal_bitmap_next_clear_bit(shm->bitmap, last,
+						    shm->num_blocks);
+	}
+	if (first + num > shm->num_blocks) {
+		metal_spinlock_release(&shm->lock);
+		return NULL;
+	}
+	for (bit = first; bit < first + num; bit++)
+		metal_bitmap_set_bit(shm->bitmap, bit);
+	metal_spinlock_release(&shm->lock);
+
+	desc->offset = first * shm->block_size;
+	desc->len = len;
+	return metal_io_virt(shm->io, desc->offset);
+}
+
+void rpmsg_rpc_shm_free(struct rpmsg_rpc_shm *shm,
+			const struct rpmsg_rpc_shm_desc *desc)
+{
+	unsigned int first, num, bit;
+
+	if (!shm || !shm->bitmap || !desc || !desc->len ||
+	    desc->offset % shm->block_size)
+		return;
+
+	first = desc->offset / shm->block_size;
+	num = metal_div_round_up(desc->len, shm->block_size);
+	if (first >= shm->num_blocks || num > shm->num_blocks - first)
+		return;
+
+	metal_spinlock_acquire(&shm->lock);
+	for (bit = first; bit < first + num; bit++)
+		metal_bitmap_clear_bit(shm->bitmap, bit);
+	metal_spinlock_release(&shm->lock);
+}
+
+/* Check that a descriptor is inside the shared memory region */
+static void *rpmsg_rpc_shm_desc_virt(struct rpmsg_rpc_shm *shm,
+				     const struct rpmsg_rpc_shm_desc *desc)
+{
+	size_t size;
+
+	if (!shm || !desc)
+		return NULL;
+
+	size = metal_io_region_size(shm->io);
+	if (desc->offset > size || desc->len > size - desc->offset)
+		return NULL;
+
+	return metal_io_virt(shm->io, desc->offset);
+}
+
+void *rpmsg_rpc_shm_data(struct rpmsg_rpc_shm *shm,
+			 const struct rpmsg_rpc_shm_desc *desc)
+{
+	void *data;
+
+	data = rpmsg_rpc_shm_desc_virt(shm, desc);
+	if (data && desc->len)
+		BUFFER_INVALIDATE(data, desc->len);
+
+	return data;
+}
+
+int rpmsg_rpc_shm_flush(struct rpmsg_rpc_shm *shm,
+			const struct rpmsg_rpc_shm_desc *desc)
+{
+	void *data;
+
+	data = rpmsg_rpc_shm_desc_virt(shm, desc);
+	if (!data)
+		return -EINVAL;
+	if (desc->len)
+		BUFFER_FLUSH(data, desc->len);
+
+	return 0;
+}
@@ -33,3 +33,123 @@ size_t safe_strcpy(char *dst, size_t d_size, const char *src, size_t s_size)
 
 	return size - nleft;
 }
+
+uint32_t fnv1a_hash32(uint32_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x01000193U;
+	}
+
+	return hash;
+}
+
+#define XXH32_PRIME1 0x9E3779B1U
+#define XXH32_PRIME2 0x85EBCA77U
+#define XXH32_PRIME3 0xC2B2AE3DU
+#define XXH32_PRIME4 0x27D4EB2FU
+#define XXH32_PRIME5 0x165667B1U
+
+static uint32_t xxh32_rotl(uint32_t x, unsigned int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32_read32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input)
+{
+	acc += input * XXH32_PRIME2;
+	return xxh32_rotl(acc, 13) * XXH32_PRIME1;
+}
+
+static void xxh32_stripe(struct xxh32_state *state, const unsigned char *p)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+		state->v[i] = xxh32_round(state->v[i], xxh32_read32(p + 4 * i));
+	state->large = 1;
+}
+
+void xxh32_init(struct xxh32_state *state, uint32_t seed)
+{
+	memset(state, 0, sizeof(*state));
+	state->seed = seed;
+	state->v[0] = seed + XXH32_PRIME1 + XXH32_PRIME2;
+	state->v[1] = seed + XXH32_PRIME2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH32_PRIME1;
+}
+
+void xxh32_update(struct xxh32_state *state, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t n;
+
+	state->total_len += (uint32_t)len;
+	if (state->buf_len) {
+		n = metal_min(len, sizeof(state->buf) - state->buf_len);
+		memcpy(state->buf + state->buf_len, p, n);
+		state->buf_len += n;
+		p += n;
+		len -= n;
+		if (state->buf_len < sizeof(state->buf))
+			return;
+		xxh32_stripe(state, state->buf);
+		state->buf_len = 0;
+	}
+	for (; len >= sizeof(state->buf); len -= sizeof(state->buf)) {
+		xxh32_stripe(state, p);
+		p += sizeof(state->buf);
+	}
+	memcpy(state->buf, p, len);
+	state->buf_len = len;
+}
+
+uint32_t xxh32_digest(const struct xxh32_state *state)
+{
+	const unsigned char *p = state->buf;
+	const unsigned char *end = p + state->buf_len;
+	uint32_t h;
+
+	if (state->large)
+		h = xxh32_rotl(state->v[0], 1) + xxh32_rotl(state->v[1], 7) +
+		    xxh32_rotl(state->v[2], 12) + xxh32_rotl(state->v[3], 18);
+	else
+		h = state->seed + XXH32_PRIME5;
+	h += state->total_len;
+
+	for (; p + 4 <= end; p += 4) {
+		h += xxh32_read32(p) * XXH32_PRIME3;
+		h = xxh32_rotl(h, 17) * XXH32_PRIME4;
+	}
+	for (; p < end; p++) {
+		h += *p * XXH32_PRIME5;
+		h = xxh32_rotl(h, 11) * XXH32_PRIME1;
+	}
+
+	h ^= h >> 15;
+	h *= XXH32_PRIME2;
+	h ^= h >> 13;
+	h *= XXH32_PRIME3;
+	h ^= h >> 16;
+
+	return h;
+}
+
+uint32_t xxh32(const void *data, size_t len, uint32_t seed)
+{
+	struct xxh32_state state;
+
+	xxh32_init(&state, seed);
+	xxh32_update(&state, data, len);
+
+	return xxh32_digest(&state);
+}
@@ -83,8 +83,9 @@ int virtio_create_virtqueues(struct virtio_device *vdev, unsigned int flags,
 			offset = metal_io_virt_to_offset(io,
 							 vring_alloc->vaddr);
 			metal_io_block_set(io, offset, 0,
-					   vring_size(vring_alloc->num_descs,
-						      vring_alloc->align));
+					   vring_size_cache_aligned(vring_alloc->num_descs,
+								    vring_alloc->align,
+								    vring_alloc->cache_line));
 		}
 		ret = virtqueue_create(vdev, i, names[i], vring_alloc,
 				       callbacks[i], vdev->func->notify,
@@ -173,6 +173,12 @@ int virtio_mmio_device_init(struct virtio_mmio_device *vmdev, uintptr_t virt_mem
 	struct virtio_device *vdev = &vmdev->vdev;
 	uint32_t magic, version, devid, vendor;
 
+	if (!VIRTIO_ROLE_IS_SUPPORTED(vmdev->device_mode)) {
+		metal_log(METAL_LOG_ERROR, "Role %u is not built in\n",
+			  vmdev->device_mode);
+		return -1;
+	}
+
 	vdev->role = vmdev->device_mode;
 	vdev->priv = vmdev;
 	vdev->func = &virtio_mmio_dispatch;